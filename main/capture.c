@@ -0,0 +1,193 @@
+#include <driver/uart.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+
+#include "capture.h"
+#include "console.h"
+#include "diagnostics.h"
+
+#if DISPLAY_CAPTURE
+
+#define CAPTURE_UART_NUM  UART_NUM_1
+#define CAPTURE_PIN_TX    4
+#define CAPTURE_BAUD_RATE 921600
+#define CAPTURE_RING_SIZE 4096
+
+//frame header: 2 sync bytes, flags, 16-bit frame number, 16-bit payload length, all little endian
+#define CAPTURE_SYNC_0       0xC5
+#define CAPTURE_SYNC_1       0x7A
+#define CAPTURE_FLAG_KEY     0x01
+#define CAPTURE_HEADER_SIZE  7
+#define CAPTURE_RUN_MAX      128
+#define CAPTURE_FRAME_BYTES  (DISPLAY_WIDTH * DISPLAY_HEIGHT / 8)
+
+static const char *TAG = "capture";
+
+//payload tokens run over the frame XORed with the previous one in page order:
+//0x00-0x7F = n + 1 literal XOR bytes follow, 0x80-0xFF = n + 1 unchanged bytes, trailing unchanged bytes are left out
+static uint8_t capture_ring[CAPTURE_RING_SIZE];
+static uint8_t capture_previous[CAPTURE_FRAME_BYTES];
+static uint32_t capture_head = 0, capture_tail = 0;
+
+//encoder state of the frame being written, nothing is visible to the drain until capture_end_frame
+static uint32_t capture_write, capture_frame_start, capture_literal_at;
+static short int capture_literal_count, capture_zero_count;
+static bool capture_overflow, capture_need_key = true, capture_key;
+static uint16_t capture_frame_number = 0;
+
+static int64_t capture_time_us = 0;
+static int capture_bytes = 0, capture_dropped = 0;
+
+void capture_init(void)
+{
+    uart_config_t config = {
+        .baud_rate = CAPTURE_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    uart_driver_install(CAPTURE_UART_NUM, 256, CAPTURE_RING_SIZE, 0, NULL, 0);
+    uart_param_config(CAPTURE_UART_NUM, &config);
+    uart_set_pin(CAPTURE_UART_NUM, CAPTURE_PIN_TX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    diagnostics_static("capture", sizeof(capture_ring) + sizeof(capture_previous));
+    ESP_LOGI(TAG, "streaming frame deltas on uart %d, tx pin %d, %d baud", CAPTURE_UART_NUM, CAPTURE_PIN_TX, CAPTURE_BAUD_RATE);
+}
+
+static void capture_put(uint8_t byte)
+{
+    if(capture_write - capture_tail >= CAPTURE_RING_SIZE)
+    {
+        capture_overflow = true;
+        return;
+    }
+    capture_ring[capture_write++ % CAPTURE_RING_SIZE] = byte;
+}
+
+static void capture_set(uint32_t position, uint8_t byte)
+{
+    if(!capture_overflow)
+        capture_ring[position % CAPTURE_RING_SIZE] = byte;
+}
+
+static void capture_close_literal(void)
+{
+    if(capture_literal_count == 0)
+        return;
+    capture_set(capture_literal_at, capture_literal_count - 1);
+    capture_literal_count = 0;
+}
+
+static void capture_flush_zeros(void)
+{
+    while(capture_zero_count > 0)
+    {
+        short int run = capture_zero_count > CAPTURE_RUN_MAX ? CAPTURE_RUN_MAX : capture_zero_count;
+        capture_put(0x80 | (run - 1));
+        capture_zero_count -= run;
+    }
+}
+
+void capture_begin_frame(void)
+{
+    capture_time_us -= esp_timer_get_time();
+    capture_overflow = false;
+    capture_key = capture_need_key;
+    capture_literal_count = 0, capture_zero_count = 0;
+    capture_frame_start = capture_write = capture_head;
+    for(int i = 0; i < CAPTURE_HEADER_SIZE; i++)
+        capture_put(0);
+    capture_time_us += esp_timer_get_time();
+}
+
+//called with the pages the buffer holds right before they go out, all of them in full buffer mode
+void capture_pages(short int first_page, short int page_count, const uint8_t *pages)
+{
+    capture_time_us -= esp_timer_get_time();
+    uint8_t *previous = capture_previous + first_page * DISPLAY_WIDTH;
+    for(int i = 0; i < page_count * DISPLAY_WIDTH && !capture_overflow; i++)
+    {
+        uint8_t delta = capture_key ? pages[i] : pages[i] ^ previous[i];
+        previous[i] = pages[i];
+        if(delta == 0)
+        {
+            capture_close_literal();
+            capture_zero_count++;
+            continue;
+        }
+        capture_flush_zeros();
+        if(capture_literal_count == 0)
+        {
+            capture_literal_at = capture_write;
+            capture_put(0);
+        }
+        capture_put(delta);
+        if(++capture_literal_count == CAPTURE_RUN_MAX)
+            capture_close_literal();
+    }
+    capture_time_us += esp_timer_get_time();
+}
+
+//publishes the frame and hands whatever the UART driver can take without blocking
+void capture_end_frame(void)
+{
+    capture_time_us -= esp_timer_get_time();
+    capture_close_literal();
+    uint32_t length = capture_write - capture_frame_start - CAPTURE_HEADER_SIZE;
+    if(capture_overflow || length > 0xFFFF)
+    {
+        //the previous frame copy already moved on, so the decoder needs a full frame next time
+        capture_dropped++;
+        capture_need_key = true;
+    }
+    else
+    {
+        capture_set(capture_frame_start, CAPTURE_SYNC_0);
+        capture_set(capture_frame_start + 1, CAPTURE_SYNC_1);
+        capture_set(capture_frame_start + 2, capture_key ? CAPTURE_FLAG_KEY : 0);
+        capture_set(capture_frame_start + 3, capture_frame_number & 0xFF);
+        capture_set(capture_frame_start + 4, capture_frame_number >> 8);
+        capture_set(capture_frame_start + 5, length & 0xFF);
+        capture_set(capture_frame_start + 6, length >> 8);
+        capture_head = capture_write;
+        capture_need_key = false;
+        capture_bytes += length + CAPTURE_HEADER_SIZE;
+    }
+    capture_frame_number++;
+
+    size_t free_bytes = 0;
+    uart_get_tx_buffer_free_size(CAPTURE_UART_NUM, &free_bytes);
+    while(free_bytes > 0 && capture_tail != capture_head)
+    {
+        uint32_t offset = capture_tail % CAPTURE_RING_SIZE;
+        uint32_t chunk = capture_head - capture_tail;
+        if(chunk > CAPTURE_RING_SIZE - offset)
+            chunk = CAPTURE_RING_SIZE - offset;
+        if(chunk > free_bytes)
+            chunk = free_bytes;
+        uart_write_bytes(CAPTURE_UART_NUM, capture_ring + offset, chunk);
+        capture_tail += chunk;
+        free_bytes -= chunk;
+    }
+    capture_time_us += esp_timer_get_time();
+}
+
+void capture_report(int frames)
+{
+    ESP_LOGI(TAG, "%d us/frame, %d bytes/frame, %d frames dropped",
+        (int)(capture_time_us / frames), capture_bytes / frames, capture_dropped);
+    capture_time_us = 0;
+    capture_bytes = 0;
+}
+
+#else
+
+void capture_init(void) {}
+void capture_begin_frame(void) {}
+void capture_pages(short int first_page, short int page_count, const uint8_t *pages) {}
+void capture_end_frame(void) {}
+void capture_report(int frames) {}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 1 = stream every frame's changed bytes over CAPTURE_UART_NUM, decode with tools/capture_decode.py
+#ifndef DISPLAY_CAPTURE
+#define DISPLAY_CAPTURE 0
+#endif
+
+void capture_init(void);
+void capture_begin_frame(void);
+void capture_pages(short int first_page, short int page_count, const uint8_t *pages);
+void capture_end_frame(void);
+void capture_report(int frames);
+
+#endif
@@ -0,0 +1,712 @@
+#include <driver/gpio.h>
+#include <driver/i2c_master.h>
+#include <esp_cpu.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sdkconfig.h"
+#include "driver/rtc_io.h"
+#include "esp_sleep.h"
+
+#include <u8g2.h>
+#include "u8g2_esp32_hal.h"
+
+#include "capture.h"
+#include "console.h"
+#include "dataset.h"
+#include "diagnostics.h"
+#include "input.h"
+#include "telemetry.h"
+
+#define LEFT_BUTTON  15
+#define DOWN_BUTTON  2
+#define UP_BUTTON    27
+#define RIGHT_BUTTON 26
+
+#define PIN_SDA 21
+#define PIN_SCL 22
+
+#define PIN_SPI_CLK   18
+#define PIN_SPI_MOSI  23
+#define PIN_SPI_CS    5
+#define PIN_SPI_DC    17
+#define PIN_SPI_RESET 16
+
+//frame rate cap of the runtime, slower frames simply run back to back
+//game logic runs at a fixed tick, in a game frames are drawn as fast as the display takes them
+#define CONSOLE_TICK_US      33333
+#define CONSOLE_MAX_CATCH_UP 4
+#define CONSOLE_STATS_FRAMES 200
+#define CONSOLE_IDLE_US      20000000   //no input this long outside a game puts the console to sleep
+#define CONSOLE_BLINK_US     1000000
+#define CONSOLE_SNAPSHOT_BYTES 512
+
+#define LATENCY_SAMPLES 256
+
+// 0 = full 1 KB framebuffer, 1 or 2 = u8g2 page buffer of 128 or 256 bytes
+#ifndef DISPLAY_BUFFER_PAGES
+#define DISPLAY_BUFFER_PAGES 0
+#endif
+#define DISPLAY_STATS_FRAMES 200
+
+#define DISPLAY_TRANSPORT_I2C  0
+#define DISPLAY_TRANSPORT_SPI  1
+#define DISPLAY_TRANSPORT_MOCK 2
+#ifndef DISPLAY_TRANSPORT
+#define DISPLAY_TRANSPORT DISPLAY_TRANSPORT_I2C
+#endif
+
+// sh1106 or ssd1306, the SPI backend supports both
+#ifndef DISPLAY_CONTROLLER
+#define DISPLAY_CONTROLLER sh1106
+#endif
+
+// the bus clocks are set inside the HAL, not here. time on the running bus is measured, these
+// clocks only model the other bus for the what-if fps in the stats: the I2C one is the HAL's
+// I2C_MASTER_FREQ_HZ, the SPI one is an assumed clock for a module you do not have wired up
+#ifdef I2C_MASTER_FREQ_HZ
+#define DISPLAY_I2C_CLOCK_HZ I2C_MASTER_FREQ_HZ
+#else
+#define DISPLAY_I2C_CLOCK_HZ 400000
+#endif
+#ifndef DISPLAY_SPI_CLOCK_HZ
+#define DISPLAY_SPI_CLOCK_HZ 8000000
+#endif
+
+// set to 1 to time the HUD number drawing at boot
+#ifndef DISPLAY_BENCHMARKS
+#define DISPLAY_BENCHMARKS 0
+#endif
+
+#if DISPLAY_BUFFER_PAGES == 1
+#define DISPLAY_BUFFER_SUFFIX 1
+#elif DISPLAY_BUFFER_PAGES == 2
+#define DISPLAY_BUFFER_SUFFIX 2
+#else
+#define DISPLAY_BUFFER_SUFFIX f
+#endif
+#define DISPLAY_CONTROLLER_I2C__(controller) controller##_i2c
+#define DISPLAY_CONTROLLER_I2C_(controller) DISPLAY_CONTROLLER_I2C__(controller)
+#define DISPLAY_CONTROLLER_I2C DISPLAY_CONTROLLER_I2C_(DISPLAY_CONTROLLER)
+#define DISPLAY_SETUP__(controller, suffix) u8g2_Setup_##controller##_128x64_noname_##suffix
+#define DISPLAY_SETUP_(controller, suffix) DISPLAY_SETUP__(controller, suffix)
+#define DISPLAY_SETUP(controller) DISPLAY_SETUP_(controller, DISPLAY_BUFFER_SUFFIX)
+
+static const char *TAG = "console";
+
+u8g2_t u8g2;
+static u8g2_esp32_hal_t u8g2_esp32_hal = U8G2_ESP32_HAL_DEFAULT;
+
+static const int console_button_pins[BUTTON_COUNT] = {LEFT_BUTTON, DOWN_BUTTON, UP_BUTTON, RIGHT_BUTTON};
+
+static const console_game *console_games[] = {&tetris_game};
+#define CONSOLE_NUMBER_OF_GAMES (sizeof(console_games)/sizeof(console_games[0]))
+
+typedef enum console_scene
+{
+    SCENE_MENU, SCENE_GAME, SCENE_END
+} console_scene;
+
+//every screen is a scene ticked and drawn by the one frame loop, switching scenes takes effect the same frame
+typedef struct console_state
+{
+    console_scene scene;
+    short int selected;
+    const console_game *game;
+    console_frame frame;
+    int64_t last_input_us, woke_us;
+    int64_t next_tick_us;
+    bool save_pending;
+    int64_t stats_started_us, tick_time_us, present_time_us;
+    int ticks, frames;
+} console_state;
+
+static console_state console;
+static uint8_t console_snapshot[CONSOLE_SNAPSHOT_BYTES];
+
+static input_repeat console_buttons[BUTTON_COUNT];
+
+typedef struct display_transport
+{
+    const char *name;
+    u8x8_msg_cb byte_cb;
+} display_transport;
+
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_I2C
+static display_transport display_bus = {"i2c", NULL};
+#elif DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_SPI
+static display_transport display_bus = {"spi", NULL};
+#else
+static display_transport display_bus = {"mock", NULL};
+#endif
+
+//3x5 digits matching u8g2_font_4x6_tf, one byte per column with the top row in bit 0
+static const uint8_t display_digit_columns[10][DISPLAY_DIGIT_WIDTH] = {
+    {0x1F, 0x11, 0x1F}, {0x12, 0x1F, 0x10}, {0x1D, 0x15, 0x17}, {0x15, 0x15, 0x1F},
+    {0x07, 0x04, 0x1F}, {0x17, 0x15, 0x1D}, {0x1F, 0x15, 0x1D}, {0x01, 0x01, 0x1F},
+    {0x1F, 0x15, 0x1F}, {0x17, 0x15, 0x1F}
+};
+
+//input-to-photon latency, edges are timestamped in the GPIO ISR and closed when the next frame is on the panel
+static volatile int64_t latency_edge_us[BUTTON_COUNT] = {0};
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;   //64-bit edge times are not written atomically
+static int64_t latency_pending_us = 0;
+static int latency_samples_us[LATENCY_SAMPLES];
+static int latency_sample_count = 0;
+
+static int64_t display_frame_time_us = 0;
+static int display_frame_count = 0;
+static int64_t display_bus_time_us = 0;
+static int display_bus_bytes = 0;
+static int display_bus_transfers = 0;
+
+void init_low_power_mode()
+{
+    uint64_t buttonPinMask = (1ULL << LEFT_BUTTON) | (1ULL << DOWN_BUTTON) |
+                             (1ULL << RIGHT_BUTTON) | (1ULL << UP_BUTTON);
+    esp_sleep_enable_ext1_wakeup(buttonPinMask, ESP_EXT1_WAKEUP_ANY_HIGH);
+}
+
+//keeps only the first edge per button, bounces after it are ignored until the press is consumed
+static void IRAM_ATTR latency_button_isr(void *arg)
+{
+    intptr_t button = (intptr_t)arg;
+    portENTER_CRITICAL_ISR(&latency_lock);
+    if(latency_edge_us[button] == 0)
+        latency_edge_us[button] = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&latency_lock);
+}
+
+void init_buttons()
+{
+    gpio_install_isr_service(0);
+    for(int i = 0; i < BUTTON_COUNT; i++)
+    {
+        gpio_reset_pin(console_button_pins[i]);
+        gpio_set_direction(console_button_pins[i], GPIO_MODE_INPUT);
+        gpio_pullup_dis(console_button_pins[i]);
+        gpio_pulldown_en(console_button_pins[i]);
+        gpio_set_intr_type(console_button_pins[i], GPIO_INTR_POSEDGE);
+        gpio_isr_handler_add(console_button_pins[i], latency_button_isr, (void *)(intptr_t)i);
+    }
+}
+
+//drops edges that were never acted on, e.g. the press that woke the chip
+void latency_reset()
+{
+    portENTER_CRITICAL(&latency_lock);
+    for(int i = 0; i < BUTTON_COUNT; i++)
+        latency_edge_us[i] = 0;
+    portEXIT_CRITICAL(&latency_lock);
+    latency_pending_us = 0;
+    latency_sample_count = 0;
+}
+
+//runs every frame with the buttons read at read_us. only a fresh press consumes its button's edge, the oldest
+//of those is what the player is waiting on. edges of buttons no longer down (release bounce) and of buttons
+//held since an earlier frame are dropped, an edge newer than the read is kept for the next frame
+void latency_input_consumed(const bool *pressed, const bool *down, int64_t read_us)
+{
+    portENTER_CRITICAL(&latency_lock);
+    for(int i = 0; i < BUTTON_COUNT; i++)
+    {
+        int64_t edge_us = latency_edge_us[i];
+        if(edge_us == 0 || (!down[i] && edge_us >= read_us))
+            continue;
+        if(pressed[i] && (latency_pending_us == 0 || edge_us < latency_pending_us))
+            latency_pending_us = edge_us;
+        latency_edge_us[i] = 0;
+    }
+    portEXIT_CRITICAL(&latency_lock);
+}
+
+void latency_frame_committed()
+{
+    if(latency_pending_us == 0)
+        return;
+    latency_samples_us[latency_sample_count % LATENCY_SAMPLES] = esp_timer_get_time() - latency_pending_us;
+    latency_sample_count++;
+    latency_pending_us = 0;
+}
+
+int latency_compare(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+void latency_report()
+{
+    int count = latency_sample_count < LATENCY_SAMPLES ? latency_sample_count : LATENCY_SAMPLES;
+    if(count == 0)
+        return;
+    qsort(latency_samples_us, count, sizeof(latency_samples_us[0]), latency_compare);
+    ESP_LOGI(TAG, "input to photon over %d presses: min %d us, p50 %d us, p99 %d us", count,
+        latency_samples_us[0], latency_samples_us[count / 2], latency_samples_us[count * 99 / 100]);
+}
+
+//counts every byte u8g2 pushes to the bus and forwards it to the selected backend, timing the backend
+//so the stats know how long the frame spent on the bus at whatever clock the HAL runs it
+uint8_t display_counting_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+    if(msg == U8X8_MSG_BYTE_SEND)
+        display_bus_bytes += arg_int;
+    else if(msg == U8X8_MSG_BYTE_START_TRANSFER)
+        display_bus_transfers++;
+    if(display_bus.byte_cb == NULL)
+        return 1;
+    int64_t start = esp_timer_get_time();
+    uint8_t result = display_bus.byte_cb(u8x8, msg, arg_int, arg_ptr);
+    display_bus_time_us += esp_timer_get_time() - start;
+    return result;
+}
+
+uint8_t display_mock_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+    return 1;
+}
+
+//modeled time on the wire for the given traffic, I2C adds an address byte and an ack bit per byte
+int display_bus_model_us(int bytes, int transfers, int transport)
+{
+    if(transport == DISPLAY_TRANSPORT_I2C)
+        return (int)((int64_t)(bytes + transfers) * 9 * 1000000 / DISPLAY_I2C_CLOCK_HZ);
+    if(transport == DISPLAY_TRANSPORT_SPI)
+        return (int)((int64_t)bytes * 8 * 1000000 / DISPLAY_SPI_CLOCK_HZ);
+    return 0;
+}
+
+void init_display()
+{
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_I2C
+    u8g2_esp32_hal.bus.i2c.sda = PIN_SDA;
+    u8g2_esp32_hal.bus.i2c.scl = PIN_SCL;
+    u8g2_esp32_hal_init(u8g2_esp32_hal);
+    display_bus.byte_cb = u8g2_esp32_i2c_byte_cb;
+    DISPLAY_SETUP(DISPLAY_CONTROLLER_I2C)(&u8g2, U8G2_R0,
+        display_counting_byte_cb,
+        u8g2_esp32_gpio_and_delay_cb); 
+    u8x8_SetI2CAddress(&u8g2.u8x8, 0x78);
+#elif DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_SPI
+    u8g2_esp32_hal.bus.spi.clk = PIN_SPI_CLK;
+    u8g2_esp32_hal.bus.spi.mosi = PIN_SPI_MOSI;
+    u8g2_esp32_hal.bus.spi.cs = PIN_SPI_CS;
+    u8g2_esp32_hal.dc = PIN_SPI_DC;
+    u8g2_esp32_hal.reset = PIN_SPI_RESET;
+    u8g2_esp32_hal_init(u8g2_esp32_hal);
+    display_bus.byte_cb = u8g2_esp32_spi_byte_cb;
+    DISPLAY_SETUP(DISPLAY_CONTROLLER)(&u8g2, U8G2_R0,
+        display_counting_byte_cb,
+        u8g2_esp32_gpio_and_delay_cb);
+#else
+    //nothing is wired up, frames are only counted so render cost can be measured without a bus
+    DISPLAY_SETUP(DISPLAY_CONTROLLER_I2C)(&u8g2, U8G2_R0,
+        display_counting_byte_cb,
+        display_mock_gpio_and_delay_cb);
+#endif
+    
+    u8g2_InitDisplay(&u8g2);  // initialize display, display is in sleep mode after this
+    u8g2_SetPowerSave(&u8g2, 0);  // wake up display
+    u8g2_ClearDisplay(&u8g2);
+
+    int buffer_bytes = u8g2_GetBufferTileHeight(&u8g2) * u8g2_GetBufferTileWidth(&u8g2) * 8;
+    ESP_LOGI(TAG, "display on %s, buffer %d bytes (%d saved vs full buffer)", display_bus.name,
+        buffer_bytes, DISPLAY_WIDTH * DISPLAY_HEIGHT / 8 - buffer_bytes);
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_I2C
+    ESP_LOGI(TAG, "i2c clock %d kHz, fixed by the HAL", DISPLAY_I2C_CLOCK_HZ / 1000);
+#endif
+    diagnostics_static("display", sizeof(u8g2) + sizeof(u8g2_esp32_hal) + buffer_bytes);
+}
+
+//logs measured frame rate plus what each backend could reach with the same traffic, the render time
+//is the frame minus the measured bus time, the other buses are modeled on top of it
+void display_report_stats()
+{
+    int frame_us = (int)(display_frame_time_us / display_frame_count);
+    int bus_us = (int)(display_bus_time_us / display_frame_count);
+    int bytes = display_bus_bytes / display_frame_count;
+    int transfers = display_bus_transfers / display_frame_count;
+    int render_us = frame_us - bus_us;
+    if(render_us < 0)
+        render_us = 0;
+
+    ESP_LOGI(TAG, "frame time %d us avg over %d frames (buffer pages: %d, 0 = full), %d bytes in %d transfers taking %d us",
+        frame_us, display_frame_count, DISPLAY_BUFFER_PAGES, bytes, transfers, bus_us);
+    ESP_LOGI(TAG, "fps measured on %s: %d, no bus: %d, modeled i2c@%dkHz: %d, spi@%dkHz: %d",
+        display_bus.name, 1000000 / (frame_us ? frame_us : 1), 1000000 / (render_us + 1),
+        DISPLAY_I2C_CLOCK_HZ / 1000, 1000000 / (render_us + display_bus_model_us(bytes, transfers, DISPLAY_TRANSPORT_I2C) + 1),
+        DISPLAY_SPI_CLOCK_HZ / 1000, 1000000 / (render_us + display_bus_model_us(bytes, transfers, DISPLAY_TRANSPORT_SPI) + 1));
+    capture_report(display_frame_count);
+}
+
+//draws one complete frame, in page mode the render callback runs once per page
+//so it must only draw, never advance game state
+void display_present(display_render_cb render, const void *ctx)
+{
+    int64_t start = esp_timer_get_time();
+    capture_begin_frame();
+#if DISPLAY_BUFFER_PAGES == 0
+    u8g2_ClearBuffer(&u8g2);
+    render(ctx);
+    capture_pages(0, u8g2_GetBufferTileHeight(&u8g2), u8g2_GetBufferPtr(&u8g2));
+    u8g2_SendBuffer(&u8g2);
+#else
+    u8g2_FirstPage(&u8g2);
+    do
+    {
+        render(ctx);
+        capture_pages(u8g2_GetBufferCurrTileRow(&u8g2), u8g2_GetBufferTileHeight(&u8g2), u8g2_GetBufferPtr(&u8g2));
+    } while(u8g2_NextPage(&u8g2));
+#endif
+    latency_frame_committed();
+    capture_end_frame();
+    display_frame_time_us += esp_timer_get_time() - start;
+    display_frame_count++;
+    if(display_frame_count == DISPLAY_STATS_FRAMES)
+    {
+        display_report_stats();
+        display_frame_time_us = 0;
+        display_frame_count = 0;
+        display_bus_time_us = 0;
+        display_bus_bytes = 0;
+        display_bus_transfers = 0;
+    }
+}
+
+short int display_number_width(int value, short int scale)
+{
+    short int count = 1;
+    while(value >= 10)
+    {
+        value /= 10;
+        count++;
+    }
+    return count*DISPLAY_DIGIT_ADVANCE*scale - scale;
+}
+
+//writes digits straight into the u8g2 tile buffer, right aligned so the last column lands on x_right - 1,
+//scale 2 doubles every pixel; only the pages held by the current buffer are touched so page mode works too
+void display_draw_number(short int x_right, short int y_top, int value, short int scale)
+{
+    uint8_t digits[10];
+    short int count = 0;
+    if(value < 0)
+        value = 0;
+    do
+    {
+        digits[count++] = value % 10;
+        value /= 10;
+    } while(value > 0);
+
+    uint8_t *buffer = u8g2_GetBufferPtr(&u8g2);
+    short int first_page = u8g2_GetBufferCurrTileRow(&u8g2);
+    short int last_page = first_page + u8g2_GetBufferTileHeight(&u8g2) - 1;
+    short int x = x_right - count*DISPLAY_DIGIT_ADVANCE*scale + scale;
+    for(int i = count - 1; i >= 0; i--, x += DISPLAY_DIGIT_ADVANCE*scale)
+    {
+        for(int col = 0; col < DISPLAY_DIGIT_WIDTH*scale; col++)
+        {
+            if(x + col < 0 || x + col >= DISPLAY_WIDTH)
+                continue;
+            uint32_t mask = display_digit_columns[digits[i]][col / scale];
+            if(scale == 2)
+            {
+                uint32_t wide = 0;
+                for(int bit = 0; bit < DISPLAY_DIGIT_HEIGHT; bit++)
+                    if(mask & (1 << bit))
+                        wide |= 3 << (2*bit);
+                mask = wide;
+            }
+            mask <<= y_top & 7;
+            for(short int page = y_top >> 3; mask; mask >>= 8, page++)
+                if(page >= first_page && page <= last_page)
+                    buffer[(page - first_page)*DISPLAY_WIDTH + x + col] |= mask & 0xFF;
+        }
+    }
+}
+
+//times the old snprintf + font path against the blitter for the two HUD numbers
+void display_benchmark_numbers()
+{
+    const int runs = 100;
+    char buf[16];
+    u8g2_SetFont(&u8g2, u8g2_font_4x6_tf);
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < runs; i++)
+    {
+        snprintf(buf, sizeof(buf), "%d", 123450 + i);
+        u8g2_DrawStr(&u8g2, 57 - u8g2_GetStrWidth(&u8g2, buf), 14, buf);
+        snprintf(buf, sizeof(buf), "%d", i % 10);
+        u8g2_DrawStr(&u8g2, 57 - u8g2_GetStrWidth(&u8g2, buf), 32, buf);
+    }
+    uint32_t font_cycles = (esp_cpu_get_cycle_count() - start) / runs;
+
+    start = esp_cpu_get_cycle_count();
+    for(int i = 0; i < runs; i++)
+    {
+        display_draw_number(57, 9, 123450 + i, 1);
+        display_draw_number(57, 27, i % 10, 1);
+    }
+    uint32_t blit_cycles = (esp_cpu_get_cycle_count() - start) / runs;
+
+    u8g2_ClearBuffer(&u8g2);
+    ESP_LOGI(TAG, "hud numbers: %u cycles/frame with font, %u with blitter, %u saved",
+        (unsigned)font_cycles, (unsigned)blit_cycles, (unsigned)(font_cycles - blit_cycles));
+}
+
+//applies a game's repeat settings, buttons that are already down count as held
+//so the press that got us here is not replayed
+void console_input_reset(const console_repeat *repeat, int64_t now_us)
+{
+    for(int i = 0; i < BUTTON_COUNT; i++)
+    {
+        console_buttons[i].delay_us = repeat ? repeat[i].delay_us : 0;
+        console_buttons[i].repeat_us = repeat ? repeat[i].repeat_us : 0;
+        console_buttons[i].held = gpio_get_level(console_button_pins[i]);
+        console_buttons[i].next_us = now_us + console_buttons[i].delay_us;
+    }
+}
+
+bool console_input_read(console_input *input, int64_t now_us)
+{
+    bool acted = false;
+    bool pressed[BUTTON_COUNT];
+    input->now_us = now_us;
+    for(int i = 0; i < BUTTON_COUNT; i++)
+    {
+        bool was_held = console_buttons[i].held;
+        input->held[i] = gpio_get_level(console_button_pins[i]);
+        input->steps[i] = input_repeat_update(&console_buttons[i], input->held[i], now_us);
+        pressed[i] = input->held[i] && !was_held;
+        if(input->steps[i])
+            acted = true;
+    }
+    latency_input_consumed(pressed, input->held, now_us);
+    return acted;
+}
+
+bool console_any_button_held()
+{
+    for(int i = 0; i < BUTTON_COUNT; i++)
+        if(gpio_get_level(console_button_pins[i]))
+            return true;
+    return false;
+}
+
+void console_enter(console_scene scene, int64_t now_us)
+{
+    console.scene = scene;
+    console.last_input_us = now_us;
+    switch(scene)
+    {
+        case SCENE_MENU:
+            console_input_reset(NULL, now_us);
+            break;
+        case SCENE_GAME:
+            //the first init can load flash and run benchmarks, the game starts when it returns
+            console.game->init();
+            now_us = esp_timer_get_time();
+            console.last_input_us = now_us;
+            console_input_reset(console.game->repeat, now_us);
+            latency_reset();
+            console.next_tick_us = now_us;
+            console.stats_started_us = now_us;
+            console.tick_time_us = 0, console.present_time_us = 0, console.ticks = 0, console.frames = 0;
+            break;
+        case SCENE_END:
+            console_input_reset(NULL, now_us);
+            console.frame.choice = CHOICE_PLAY_AGAIN;
+            console.save_pending = true;
+            latency_report();
+            break;
+    }
+}
+
+void console_update_menu(const console_input *input, int64_t now_us)
+{
+    if(input->steps[BUTTON_UP])
+        console.selected = (console.selected + CONSOLE_NUMBER_OF_GAMES - 1) % CONSOLE_NUMBER_OF_GAMES;
+    if(input->steps[BUTTON_DOWN])
+        console.selected = (console.selected + 1) % CONSOLE_NUMBER_OF_GAMES;
+    bool any = input->steps[BUTTON_UP] || input->steps[BUTTON_DOWN];
+    if(input->steps[BUTTON_LEFT] || input->steps[BUTTON_RIGHT] || (any && CONSOLE_NUMBER_OF_GAMES == 1))
+    {
+        console.game = console_games[console.selected];
+        console_enter(SCENE_GAME, now_us);
+    }
+}
+
+//input is applied every frame, logic ticks at their own scheduled times, a stall longer than
+//CONSOLE_MAX_CATCH_UP ticks skips the rest instead of fast-forwarding the game
+void console_update_game(const console_input *input, int64_t now_us)
+{
+    console.game->on_input(input);
+    for(short int due = 0; now_us >= console.next_tick_us; due++)
+    {
+        if(due == CONSOLE_MAX_CATCH_UP)
+        {
+            telemetry_record(TELEMETRY_TICKS_SKIPPED, 0, 0, (now_us - console.next_tick_us) / CONSOLE_TICK_US + 1);
+            console.next_tick_us = now_us + CONSOLE_TICK_US;
+            break;
+        }
+        console.ticks++;
+        if(!console.game->tick(console.next_tick_us))
+        {
+            console_enter(SCENE_END, now_us);
+            break;
+        }
+        console.next_tick_us += CONSOLE_TICK_US;
+    }
+}
+
+//LEFT and RIGHT pick an option, UP or DOWN takes it
+void console_update_end(const console_input *input, int64_t now_us)
+{
+    if(input->steps[BUTTON_LEFT])
+        console.frame.choice = CHOICE_PLAY_AGAIN;
+    if(input->steps[BUTTON_RIGHT])
+        console.frame.choice = CHOICE_EXIT;
+    if(input->steps[BUTTON_UP] || input->steps[BUTTON_DOWN])
+        console_enter(console.frame.choice == CHOICE_PLAY_AGAIN ? SCENE_GAME : SCENE_MENU, now_us);
+}
+
+void console_render_menu(const void *ctx)
+{
+    const console_frame *frame = ctx;
+    const console_game *game = console_games[console.selected];
+
+    u8g2_SetFont(&u8g2, u8g2_font_logisoso32_tr);
+    short int title_width = u8g2_GetStrWidth(&u8g2, game->name);
+    short int title_x = (DISPLAY_WIDTH - title_width) / 2;
+    u8g2_DrawStr(&u8g2, title_x, 42, game->name);
+
+    //the prompt blinks, off for the last third of every second
+    if(frame->now_us % CONSOLE_BLINK_US >= CONSOLE_BLINK_US * 2 / 3)
+        return;
+    u8g2_SetFont(&u8g2, u8g2_font_5x7_tr);
+    const char *prompt = CONSOLE_NUMBER_OF_GAMES > 1 ? "UP/DOWN pick, RIGHT play" : "Press any button to play";
+    short int prompt_width = u8g2_GetStrWidth(&u8g2, prompt);
+    short int prompt_x = (DISPLAY_WIDTH - prompt_width) / 2;
+    u8g2_DrawStr(&u8g2, prompt_x, 60, prompt);
+}
+
+void console_render_scene(const void *ctx)
+{
+    if(console.scene == SCENE_MENU)
+        console_render_menu(ctx);
+    else
+        console.game->render(ctx);
+}
+
+//the idle policy, the only place the console sleeps: after CONSOLE_IDLE_US without input outside a game,
+//light sleep until a button wakes it, that press only wakes the console
+void console_idle(int64_t now_us)
+{
+    if(console.scene == SCENE_GAME || now_us - console.last_input_us < CONSOLE_IDLE_US || console_any_button_held())
+        return;
+
+    ESP_LOGI(TAG, "idle for %d s, sleeping", (int)((now_us - console.last_input_us) / 1000000));
+    esp_light_sleep_start();
+    console.woke_us = esp_timer_get_time();
+    console.last_input_us = console.woke_us;
+    console_input_reset(NULL, console.woke_us);
+}
+
+//logs how often the game logic ran and how often a frame reached the display
+void console_report_rates(int64_t now_us)
+{
+    int64_t window_us = now_us - console.stats_started_us;
+    ESP_LOGI(TAG, "%s: logic %d Hz, render %d Hz over %d frames (input + ticks %d us, present %d us per frame)",
+        console.game->name, (int)(console.ticks * 1000000LL / window_us), (int)(console.frames * 1000000LL / window_us),
+        console.frames, (int)(console.tick_time_us / console.frames), (int)(console.present_time_us / console.frames));
+    console.stats_started_us = now_us;
+    console.tick_time_us = 0, console.present_time_us = 0, console.ticks = 0, console.frames = 0;
+}
+
+//the frame loop: input, scene update, one presented frame. outside a game a frame is paced to the
+//logic tick, in a game the display transfer paces it
+void console_loop()
+{
+    console_input input;
+    console_enter(SCENE_MENU, esp_timer_get_time());
+
+    while(true)
+    {
+        int64_t start_us = esp_timer_get_time();
+        if(console_input_read(&input, start_us))
+            console.last_input_us = start_us;
+        switch(console.scene)
+        {
+            case SCENE_MENU:
+                console_update_menu(&input, start_us);
+                break;
+            case SCENE_GAME:
+                console_update_game(&input, start_us);
+                break;
+            case SCENE_END:
+                console_update_end(&input, start_us);
+                break;
+        }
+
+        int64_t ticked_us = esp_timer_get_time();
+        console.frame.now_us = ticked_us;
+        display_present(console_render_scene, &console.frame);
+        int64_t end_us = esp_timer_get_time();
+
+        //a finished session is persisted only after its end screen has been presented, never inside a tick
+        if(console.save_pending)
+        {
+            size_t size = console.game->serialize(console_snapshot, sizeof(console_snapshot));
+            if(size > 0 && console.game->save)
+                console.game->save(console_snapshot, size);
+            console.save_pending = false;
+        }
+
+        if(console.woke_us != 0)
+        {
+            ESP_LOGI(TAG, "wake to first frame: %d us", (int)(end_us - console.woke_us));
+            console.woke_us = 0;
+        }
+
+        if(console.scene == SCENE_GAME)
+        {
+            console.tick_time_us += ticked_us - start_us;
+            console.present_time_us += end_us - ticked_us;
+            if(++console.frames == CONSOLE_STATS_FRAMES)
+                console_report_rates(end_us);
+
+            //a frame faster than one RTOS tick (mock bus) never blocked, give the idle task a turn
+            if(end_us - start_us < portTICK_PERIOD_MS * 1000)
+                vTaskDelay(1);
+        }
+        else
+        {
+            int64_t left_us = CONSOLE_TICK_US - (end_us - start_us);
+            vTaskDelay(left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) : 0);
+        }
+
+        console_idle(esp_timer_get_time());
+    }
+}
+
+void app_main(void)
+{
+    diagnostics_watch_task(xTaskGetCurrentTaskHandle());
+    diagnostics_static("console", sizeof(console) + sizeof(console_snapshot) + sizeof(console_buttons) + sizeof(latency_samples_us) + sizeof(latency_edge_us));
+    init_buttons();
+    init_display();
+    capture_init();
+    dataset_init();
+    telemetry_init();
+    if(DISPLAY_BENCHMARKS)
+        display_benchmark_numbers();
+    init_low_power_mode();
+    srand(time(0));
+
+    console_loop();
+}
@@ -0,0 +1,71 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <u8g2.h>
+
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+
+#define DISPLAY_DIGIT_WIDTH   3
+#define DISPLAY_DIGIT_HEIGHT  5
+#define DISPLAY_DIGIT_ADVANCE 4
+
+typedef enum console_button
+{
+    BUTTON_LEFT, BUTTON_DOWN, BUTTON_UP, BUTTON_RIGHT, BUTTON_COUNT
+} console_button;
+
+//auto-repeat of one button, repeat_us == 0 means it only fires on the press edge
+typedef struct console_repeat
+{
+    int64_t delay_us, repeat_us;
+} console_repeat;
+
+//what the buttons did since the last frame, steps already include auto-repeat
+typedef struct console_input
+{
+    int64_t now_us;
+    short int steps[BUTTON_COUNT];
+    bool held[BUTTON_COUNT];
+} console_input;
+
+typedef void (*display_render_cb)(const void *ctx);
+
+typedef enum console_choice
+{
+    CHOICE_PLAY_AGAIN, CHOICE_EXIT, CHOICE_COUNT
+} console_choice;
+
+//handed to a game's render callback, choice is the highlighted end screen option once the game is over
+typedef struct console_frame
+{
+    int64_t now_us;
+    console_choice choice;
+} console_frame;
+
+//a game the console can run, all state lives in the game's own static storage
+typedef struct console_game
+{
+    const char *name;
+    const console_repeat *repeat;   //one entry per button, NULL for press edges only
+    void (*init)(void);             //start a new session
+    void (*on_input)(const console_input *input);
+    bool (*tick)(int64_t now_us);   //one fixed logic step, 30 per second, false once the session is over
+    display_render_cb render;       //draw only with a console_frame, runs once per page in page mode
+    size_t (*serialize)(void *buffer, size_t size);     //snapshot of the session, 0 if it does not fit
+    void (*save)(const void *state, size_t size);       //persist a finished session from its snapshot, may write flash
+} console_game;
+
+extern u8g2_t u8g2;
+
+void display_present(display_render_cb render, const void *ctx);
+short int display_number_width(int value, short int scale);
+void display_draw_number(short int x_right, short int y_top, int value, short int scale);
+
+extern const console_game tetris_game;
+
+#endif
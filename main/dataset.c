@@ -0,0 +1,121 @@
+#include <driver/uart.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+
+#include "dataset.h"
+#include "diagnostics.h"
+
+#if DATASET_EXPORT
+
+#define DATASET_UART_NUM      UART_NUM_2
+#define DATASET_PIN_TX        25
+#define DATASET_BAUD_RATE     921600
+#define DATASET_TX_BUFFER     4096
+#define DATASET_CHUNK_RECORDS 64
+#define DATASET_REPORT_CHUNKS 16
+
+//chunk header: magic "TDS1", 16-bit record count, 16-bit payload length, little endian.
+//the payload holds one column after another so a reader can scan a single field without touching the rest:
+//rows (count * 20 * u16), block_id, next_id, block_x, rotation, lines (count * u8 each), score_delta (count * u32)
+#define DATASET_MAGIC       "TDS1"
+#define DATASET_HEADER_SIZE 8
+
+typedef struct dataset_chunk
+{
+    uint8_t header[DATASET_HEADER_SIZE];
+    uint16_t rows[DATASET_CHUNK_RECORDS][DATASET_BOARD_ROWS];
+    uint8_t block_id[DATASET_CHUNK_RECORDS], next_id[DATASET_CHUNK_RECORDS];
+    int8_t block_x[DATASET_CHUNK_RECORDS];
+    uint8_t rotation[DATASET_CHUNK_RECORDS], lines[DATASET_CHUNK_RECORDS];
+    uint32_t score_delta[DATASET_CHUNK_RECORDS];
+} dataset_chunk;
+
+_Static_assert(sizeof(dataset_chunk) == DATASET_HEADER_SIZE + DATASET_CHUNK_RECORDS * (DATASET_BOARD_ROWS * 2 + 9),
+    "dataset columns must not be padded");
+
+static const char *TAG = "dataset";
+
+static dataset_chunk dataset;
+static short int dataset_count = 0;
+static int dataset_chunks = 0, dataset_records = 0, dataset_bytes = 0;
+static int64_t dataset_started_us = 0;
+
+void dataset_init(void)
+{
+    uart_config_t config = {
+        .baud_rate = DATASET_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    uart_driver_install(DATASET_UART_NUM, 256, DATASET_TX_BUFFER, 0, NULL, 0);
+    uart_param_config(DATASET_UART_NUM, &config);
+    uart_set_pin(DATASET_UART_NUM, DATASET_PIN_TX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    diagnostics_static("dataset", sizeof(dataset));
+    dataset_started_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "streaming placements on uart %d, tx pin %d, %d baud, %d per chunk",
+        DATASET_UART_NUM, DATASET_PIN_TX, DATASET_BAUD_RATE, DATASET_CHUNK_RECORDS);
+}
+
+//the columns of a full chunk already sit back to back behind the header, a shorter one is packed down
+//to its count first, so either goes out in one write. uart_write_bytes waits once the driver buffer is
+//full, so a long soak runs at the speed of the link
+static void dataset_flush(void)
+{
+    short int n = dataset_count;
+    uint16_t length = sizeof(dataset) - DATASET_HEADER_SIZE;
+    if(n < DATASET_CHUNK_RECORDS)
+    {
+        uint8_t *payload = (uint8_t *)&dataset + DATASET_HEADER_SIZE;
+        size_t packed = n * sizeof(dataset.rows[0]);
+        const void *columns[] = {dataset.block_id, dataset.next_id, dataset.block_x, dataset.rotation, dataset.lines};
+        for(int i = 0; i < sizeof(columns) / sizeof(columns[0]); i++, packed += n)
+            memmove(payload + packed, columns[i], n);
+        memmove(payload + packed, dataset.score_delta, n * sizeof(dataset.score_delta[0]));
+        length = packed + n * sizeof(dataset.score_delta[0]);
+    }
+    memcpy(dataset.header, DATASET_MAGIC, 4);
+    dataset.header[4] = n & 0xFF, dataset.header[5] = n >> 8;
+    dataset.header[6] = length & 0xFF, dataset.header[7] = length >> 8;
+    uart_write_bytes(DATASET_UART_NUM, &dataset, DATASET_HEADER_SIZE + length);
+
+    dataset_count = 0;
+    dataset_records += n, dataset_bytes += DATASET_HEADER_SIZE + length;
+    if(++dataset_chunks % DATASET_REPORT_CHUNKS == 0)
+    {
+        int64_t elapsed_us = esp_timer_get_time() - dataset_started_us;
+        ESP_LOGI(TAG, "%d records in %d bytes, %d records/s, %d KB per million records", dataset_records, dataset_bytes,
+            (int)(dataset_records * 1000000LL / elapsed_us), (int)(dataset_bytes * 1000LL / dataset_records));
+    }
+}
+
+void dataset_record(const dataset_sample *sample)
+{
+    short int i = dataset_count++;
+    memcpy(dataset.rows[i], sample->rows, sizeof(sample->rows));
+    dataset.block_id[i] = sample->block_id;
+    dataset.next_id[i] = sample->next_id;
+    dataset.block_x[i] = sample->block_x;
+    dataset.rotation[i] = sample->rotation;
+    dataset.lines[i] = sample->lines;
+    dataset.score_delta[i] = sample->score_delta;
+    if(dataset_count == DATASET_CHUNK_RECORDS)
+        dataset_flush();
+}
+
+void dataset_flush_partial(void)
+{
+    if(dataset_count > 0)
+        dataset_flush();
+}
+
+#else
+
+void dataset_init(void) {}
+void dataset_record(const dataset_sample *sample) {}
+void dataset_flush_partial(void) {}
+
+#endif
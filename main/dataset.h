@@ -0,0 +1,28 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <stdint.h>
+
+// 1 = stream every placement the game makes over DATASET_UART_NUM, read with tools/dataset_read.py
+#ifndef DATASET_EXPORT
+#define DATASET_EXPORT 0
+#endif
+
+#define DATASET_BOARD_ROWS 20
+
+//one decision point: the board before the block locked, bit x of a row = column x filled,
+//the placement that was made and what it earned
+typedef struct dataset_sample
+{
+    uint16_t rows[DATASET_BOARD_ROWS];
+    uint8_t block_id, next_id;
+    int8_t block_x;
+    uint8_t rotation, lines;
+    uint32_t score_delta;
+} dataset_sample;
+
+void dataset_init(void);
+void dataset_record(const dataset_sample *sample);
+void dataset_flush_partial(void);    //sends the records of an unfinished chunk, e.g. when a run ends
+
+#endif
@@ -0,0 +1,64 @@
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <stdio.h>
+
+#include "diagnostics.h"
+
+#define DIAGNOSTICS_MAX_TASKS      4
+#define DIAGNOSTICS_MAX_SUBSYSTEMS 8
+
+typedef struct diagnostics_subsystem
+{
+    const char *name;
+    size_t bytes;
+} diagnostics_subsystem;
+
+static const char *TAG = "diag";
+
+static TaskHandle_t diagnostics_tasks[DIAGNOSTICS_MAX_TASKS];
+static short int diagnostics_task_count = 0;
+static diagnostics_subsystem diagnostics_subsystems[DIAGNOSTICS_MAX_SUBSYSTEMS];
+static short int diagnostics_subsystem_count = 0;
+
+//tasks whose stack high-water mark goes into the report
+void diagnostics_watch_task(TaskHandle_t task)
+{
+    if(diagnostics_task_count < DIAGNOSTICS_MAX_TASKS)
+        diagnostics_tasks[diagnostics_task_count++] = task;
+}
+
+//static RAM a subsystem owns, counted once at init
+void diagnostics_static(const char *subsystem, size_t bytes)
+{
+    if(diagnostics_subsystem_count < DIAGNOSTICS_MAX_SUBSYSTEMS)
+        diagnostics_subsystems[diagnostics_subsystem_count++] = (diagnostics_subsystem){subsystem, bytes};
+}
+
+//three lines: the least stack each task has ever had left, the heap low-water mark and fragmentation,
+//and the static RAM per subsystem. FreeRTOS fills stacks with a pattern at creation, the high-water
+//mark is how much of it was never overwritten
+void diagnostics_report(void)
+{
+    char line[160];
+    int length = 0;
+    for(int i = 0; i < diagnostics_task_count && length < sizeof(line); i++)
+        length += snprintf(line + length, sizeof(line) - length, "%s%s %u",
+            i ? ", " : "", pcTaskGetName(diagnostics_tasks[i]),
+            (unsigned)uxTaskGetStackHighWaterMark(diagnostics_tasks[i]));
+    ESP_LOGI(TAG, "stack bytes never used: %s", length ? line : "no tasks watched");
+
+    ESP_LOGI(TAG, "heap: %u free, %u lowest free, %u largest block",
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    size_t total = 0;
+    length = 0;
+    for(int i = 0; i < diagnostics_subsystem_count && length < sizeof(line); i++)
+    {
+        total += diagnostics_subsystems[i].bytes;
+        length += snprintf(line + length, sizeof(line) - length, "%s%s %u",
+            i ? ", " : "", diagnostics_subsystems[i].name, (unsigned)diagnostics_subsystems[i].bytes);
+    }
+    ESP_LOGI(TAG, "static: %u bytes (%s)", (unsigned)total, length ? line : "none");
+}
@@ -0,0 +1,13 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stddef.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+void diagnostics_watch_task(TaskHandle_t task);
+void diagnostics_static(const char *subsystem, size_t bytes);
+void diagnostics_report(void);
+
+#endif
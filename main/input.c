@@ -0,0 +1,27 @@
+#include "input.h"
+
+//returns how many steps the button produced up to now_us, more than one if the caller was late
+short int input_repeat_update(input_repeat *button, bool pressed, int64_t now_us)
+{
+    if(!pressed)
+    {
+        button->held = false;
+        return 0;
+    }
+    if(!button->held)
+    {
+        button->held = true;
+        button->next_us = now_us + button->delay_us;
+        return 1;
+    }
+    if(button->repeat_us == 0)
+        return 0;
+
+    short int steps = 0;
+    while(now_us >= button->next_us)
+    {
+        steps++;
+        button->next_us += button->repeat_us;
+    }
+    return steps;
+}
@@ -0,0 +1,17 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//a held button, repeat_us == 0 means it only fires on the press edge
+typedef struct input_repeat
+{
+    int64_t delay_us, repeat_us;
+    int64_t next_us;
+    bool held;
+} input_repeat;
+
+short int input_repeat_update(input_repeat *button, bool pressed, int64_t now_us);
+
+#endif
@@ -0,0 +1,150 @@
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "diagnostics.h"
+#include "telemetry.h"
+
+#define TELEMETRY_RING_SIZE     64
+#define TELEMETRY_MAX_IDS       16
+#define TELEMETRY_MAX_CLEAR     4
+#define TELEMETRY_MAX_LEVEL     32
+#define TELEMETRY_TIME_BUCKETS  6
+#define TELEMETRY_DRAIN_MS      200
+#define TELEMETRY_REPORT_MS     60000
+#define DIAGNOSTICS_REPORT_MS   60000
+#define TELEMETRY_TASK_STACK    2560
+
+typedef struct telemetry_event
+{
+    uint8_t type, value;
+    uint16_t extra;
+    uint32_t arg;
+} telemetry_event;
+
+//everything the aggregator has seen since boot
+typedef struct telemetry_histograms
+{
+    uint32_t pieces[TELEMETRY_MAX_IDS];
+    uint32_t clears[TELEMETRY_MAX_CLEAR + 1];
+    uint32_t piece_time[TELEMETRY_TIME_BUCKETS];   //<0.5 s, <1 s, <2 s, <4 s, <8 s, longer
+    uint32_t soft_dropped_pieces, soft_dropped_rows;
+    uint32_t level_reached[TELEMETRY_MAX_LEVEL];
+    uint32_t ticks_skipped;
+} telemetry_histograms;
+
+static const char *TAG = "telemetry";
+
+//single producer (the frame loop) and single consumer (the telemetry task), so the only
+//synchronisation is the release store of head that publishes a written slot
+static telemetry_event telemetry_ring[TELEMETRY_RING_SIZE];
+static atomic_uint telemetry_head = 0, telemetry_tail = 0;
+static atomic_uint telemetry_overflows = 0;
+static telemetry_histograms telemetry;
+
+//hot path: one slot write and one atomic store, a full ring drops the event instead of waiting
+void telemetry_record(telemetry_event_type type, uint8_t value, uint16_t extra, uint32_t arg)
+{
+    unsigned head = atomic_load_explicit(&telemetry_head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&telemetry_tail, memory_order_acquire) >= TELEMETRY_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&telemetry_overflows, 1, memory_order_relaxed);
+        return;
+    }
+    telemetry_event *event = &telemetry_ring[head % TELEMETRY_RING_SIZE];
+    event->type = type, event->value = value, event->extra = extra, event->arg = arg;
+    atomic_store_explicit(&telemetry_head, head + 1, memory_order_release);
+}
+
+static void telemetry_aggregate(const telemetry_event *event)
+{
+    switch(event->type)
+    {
+        case TELEMETRY_PIECE_PLACED:
+        {
+            if(event->value < TELEMETRY_MAX_IDS)
+                telemetry.pieces[event->value]++;
+            short int bucket = 0;
+            while(bucket < TELEMETRY_TIME_BUCKETS - 1 && event->arg >= (500u << bucket))
+                bucket++;
+            telemetry.piece_time[bucket]++;
+            if(event->extra > 0)
+            {
+                telemetry.soft_dropped_pieces++;
+                telemetry.soft_dropped_rows += event->extra;
+            }
+            break;
+        }
+        case TELEMETRY_LINES_CLEARED:
+            if(event->value <= TELEMETRY_MAX_CLEAR)
+                telemetry.clears[event->value]++;
+            break;
+        case TELEMETRY_LEVEL_CHANGED:
+            if(event->value < TELEMETRY_MAX_LEVEL)
+                telemetry.level_reached[event->value]++;
+            break;
+        case TELEMETRY_TICKS_SKIPPED:
+            telemetry.ticks_skipped += event->arg;
+            break;
+    }
+}
+
+static void telemetry_report(void)
+{
+    const uint32_t *p = telemetry.pieces;
+    const uint32_t *t = telemetry.piece_time;
+    ESP_LOGI(TAG, "pieces by id: %u %u %u %u %u %u %u %u %u",
+        (unsigned)p[0], (unsigned)p[1], (unsigned)p[2], (unsigned)p[3], (unsigned)p[4],
+        (unsigned)p[5], (unsigned)p[6], (unsigned)p[7], (unsigned)p[8]);
+    ESP_LOGI(TAG, "clears 1/2/3/4 rows: %u %u %u %u, soft drop on %u pieces for %u rows",
+        (unsigned)telemetry.clears[1], (unsigned)telemetry.clears[2], (unsigned)telemetry.clears[3],
+        (unsigned)telemetry.clears[4], (unsigned)telemetry.soft_dropped_pieces, (unsigned)telemetry.soft_dropped_rows);
+    ESP_LOGI(TAG, "time per piece <0.5/1/2/4/8/more s: %u %u %u %u %u %u",
+        (unsigned)t[0], (unsigned)t[1], (unsigned)t[2], (unsigned)t[3], (unsigned)t[4], (unsigned)t[5]);
+    for(int level = 0; level < TELEMETRY_MAX_LEVEL; level++)
+        if(telemetry.level_reached[level])
+            ESP_LOGI(TAG, "level %d reached %u times", level, (unsigned)telemetry.level_reached[level]);
+    ESP_LOGI(TAG, "logic ticks skipped: %u, events lost: %u", (unsigned)telemetry.ticks_skipped,
+        (unsigned)atomic_load_explicit(&telemetry_overflows, memory_order_relaxed));
+}
+
+static void telemetry_task(void *arg)
+{
+    TickType_t last_report = xTaskGetTickCount(), last_diagnostics = last_report;
+    bool changed = false;
+    while(true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_DRAIN_MS));
+
+        unsigned tail = atomic_load_explicit(&telemetry_tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&telemetry_head, memory_order_acquire);
+        for(; tail != head; tail++)
+            telemetry_aggregate(&telemetry_ring[tail % TELEMETRY_RING_SIZE]);
+        if(atomic_exchange_explicit(&telemetry_tail, tail, memory_order_release) != tail)
+            changed = true;
+
+        if(changed && xTaskGetTickCount() - last_report >= pdMS_TO_TICKS(TELEMETRY_REPORT_MS))
+        {
+            telemetry_report();
+            last_report = xTaskGetTickCount();
+            changed = false;
+        }
+        if(xTaskGetTickCount() - last_diagnostics >= pdMS_TO_TICKS(DIAGNOSTICS_REPORT_MS))
+        {
+            diagnostics_report();
+            last_diagnostics = xTaskGetTickCount();
+        }
+    }
+}
+
+void telemetry_init(void)
+{
+    TaskHandle_t task = NULL;
+    memset(&telemetry, 0, sizeof(telemetry));
+    xTaskCreate(telemetry_task, "telemetry", TELEMETRY_TASK_STACK, NULL, tskIDLE_PRIORITY + 1, &task);
+    diagnostics_watch_task(task);
+    diagnostics_static("telemetry", sizeof(telemetry_ring) + sizeof(telemetry));
+}
@@ -0,0 +1,17 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+typedef enum telemetry_event_type
+{
+    TELEMETRY_PIECE_PLACED,     //value = piece id, extra = soft dropped rows, arg = ms on the board
+    TELEMETRY_LINES_CLEARED,    //value = rows cleared at once
+    TELEMETRY_LEVEL_CHANGED,    //value = new level
+    TELEMETRY_TICKS_SKIPPED,    //arg = logic ticks skipped after a stall
+} telemetry_event_type;
+
+void telemetry_init(void);
+void telemetry_record(telemetry_event_type type, uint8_t value, uint16_t extra, uint32_t arg);
+
+#endif
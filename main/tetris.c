@@ -1,82 +1,340 @@
-#include <driver/gpio.h>
-#include <driver/i2c_master.h>
 #include <esp_log.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
+#include <esp_timer.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include "sdkconfig.h"
-#include "driver/rtc_io.h"
-#include "esp_sleep.h"
+#include "nvs.h"
+#include "nvs_flash.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <u8g2.h>
-#include "u8g2_esp32_hal.h"
 
-#define DISPLAY_WIDTH 128
-#define DISPLAY_HEIGHT 64
-
-#define LEFT_BUTTON  15
-#define DOWN_BUTTON  2
-#define UP_BUTTON    27
-#define RIGHT_BUTTON 26
-
-#define PIN_SDA 21
-#define PIN_SCL 22
+#include "console.h"
+#include "dataset.h"
+#include "diagnostics.h"
+#include "telemetry.h"
 
 #define TETRIS_BLOCK_SIZE 3
 #define TETRIS_MAP_WIDTH  10
 #define TETRIS_MAP_HEIGHT 20
-#define TETRIS_MAX_SPEED  5
 #define TETRIS_NUMBER_OF_BLOCKS 9
+#define TETRIS_LOCK_DELAY_US 500000
+#define TETRIS_LOCK_RESETS   15
+
+//debug builds: check the board after every tick, and optionally soak the game core with
+//random input for this many ticks before the first game. the soak starts from TETRIS_SOAK_SEED,
+//or from the timer when it is 0, and with TETRIS_SOAK_REPLAY_TICK set it plays only the first
+//game up to that tick and logs the board, which replays a failure from the seed it logged
+#ifndef TETRIS_CHECK_INVARIANTS
+#define TETRIS_CHECK_INVARIANTS 0
+#endif
+#ifndef TETRIS_SOAK_TICKS
+#define TETRIS_SOAK_TICKS 0
+#endif
+#ifndef TETRIS_SOAK_SEED
+#define TETRIS_SOAK_SEED 0
+#endif
+#ifndef TETRIS_SOAK_REPLAY_TICK
+#define TETRIS_SOAK_REPLAY_TICK 0
+#endif
+#define TETRIS_SOAK_YIELD_TICKS 1000    //lets the idle task feed the watchdog and telemetry drain
+
+//set to 1 to log kick and reachability searches per second before the first game
+#ifndef TETRIS_BENCHMARKS
+#define TETRIS_BENCHMARKS 0
+#endif
+
+//auto-repeat timing in microseconds, delayed auto-shift before the first repeat then one step per repeat interval
+#define INPUT_DAS_US       170000
+#define INPUT_ARR_US       50000
+#define INPUT_SOFT_DROP_US 40000
+
+//gravity is kept in 16.16 fixed point cells per millisecond, progress accumulates gravity * elapsed us
+//so whole rows come out of it exactly at any frame rate
+#define TETRIS_GRAVITY(cells_per_s) ((uint32_t)((cells_per_s) * 65536.0 / 1000 + 0.5))
+#define TETRIS_FALL_ROW             (65536LL * 1000)
+
+#define STATS_NAMESPACE     "tetris"
+#define STATS_TOP_SCORES    5
+#define STATS_JOURNAL_SLOTS 16
+
+static const char *TAG = "tetris";
 
-static u8g2_t u8g2;
-static u8g2_esp32_hal_t u8g2_esp32_hal = U8G2_ESP32_HAL_DEFAULT;
 static bool tetris_map[20][10];
 static int tetris_highscore = 0;
+static bool tetris_soaking = false;
 
 typedef enum block_rotation
 {
     NO_ROTATION, LEFT_90, RIGHT_90, UPSIDE_DOWN
 } block_rotation;
 
-void init_low_power_mode()
+typedef enum tetris_phase
+{
+    TETRIS_PLAYING, TETRIS_CLEARING, TETRIS_OVER
+} tetris_phase;
+
+//the whole session, kept in one static struct so it can be serialized as is
+typedef struct tetris_state
 {
-    uint64_t buttonPinMask = (1ULL << LEFT_BUTTON) | (1ULL << DOWN_BUTTON) |
-                             (1ULL << RIGHT_BUTTON) | (1ULL << UP_BUTTON);
-    esp_sleep_enable_ext1_wakeup(buttonPinMask, ESP_EXT1_WAKEUP_ANY_HIGH);
+    tetris_phase phase;
+    int score, lines, pieces;
+    int previous_highscore;
+    int64_t started_us, ended_us, lock_started_us, piece_started_us;
+    int64_t fall_updated_us, fall_progress;
+    short int block_id, block_x, block_y, lowest_y;
+    short int next_id;
+    short int level, score_multiplier;
+    short int lock_resets, soft_drop_rows;
+    short int clear_row, clear_count, clear_step;
+    block_rotation rotation;
+    bool moved, soft_drop_lock;
+} tetris_state;
+
+static tetris_state tetris;
+
+//the placement being exported, finished once its rows are cleared and scored
+static dataset_sample tetris_sample;
+static int tetris_sample_score, tetris_sample_lines;
+
+//a level is reached once either threshold is met, 30 cells/s is one row per logic tick at the console's 30 Hz tick
+typedef struct tetris_level
+{
+    int score, lines;
+    uint32_t gravity;
+} tetris_level;
+
+static const tetris_level tetris_levels[] = {
+    {     0,   0, TETRIS_GRAVITY(6)},
+    {  2000,  15, TETRIS_GRAVITY(7.5)},
+    {  4000,  30, TETRIS_GRAVITY(10)},
+    { 10000,  45, TETRIS_GRAVITY(15)},
+    { 20000,  60, TETRIS_GRAVITY(30)},
+    { 30000,  75, TETRIS_GRAVITY(36)},
+    { 40000,  90, TETRIS_GRAVITY(43)},
+    { 55000, 105, TETRIS_GRAVITY(52)},
+    { 70000, 120, TETRIS_GRAVITY(62)},
+    { 85000, 135, TETRIS_GRAVITY(75)},
+    {100000, 150, TETRIS_GRAVITY(90)},
+    {120000, 165, TETRIS_GRAVITY(120)},
+    {140000, 180, TETRIS_GRAVITY(150)},
+    {165000, 195, TETRIS_GRAVITY(180)},
+    {190000, 210, TETRIS_GRAVITY(210)},
+    {220000, 225, TETRIS_GRAVITY(240)},
+    {250000, 240, TETRIS_GRAVITY(300)},
+    {285000, 255, TETRIS_GRAVITY(360)},
+    {320000, 270, TETRIS_GRAVITY(420)},
+    {360000, 285, TETRIS_GRAVITY(480)},
+    {400000, 300, TETRIS_GRAVITY(540)},
+    {450000, 315, TETRIS_GRAVITY(600)},
+};
+#define TETRIS_NUMBER_OF_LEVELS (sizeof(tetris_levels) / sizeof(tetris_levels[0]))
+
+//reachability search over every (x, y, rotation) anchor of the active block,
+//state = (rotation * TETRIS_MAP_HEIGHT + y) * TETRIS_MAP_WIDTH + x
+#define TETRIS_REACH_STATES (4 * TETRIS_MAP_HEIGHT * TETRIS_MAP_WIDTH)
+#define TETRIS_REACH_WORDS  ((TETRIS_REACH_STATES + 31) / 32)
+
+static uint32_t tetris_reach_fits[TETRIS_REACH_WORDS];
+static uint32_t tetris_reach_visited[TETRIS_REACH_WORDS];
+static int16_t tetris_reach_parent[TETRIS_REACH_STATES];
+static uint8_t tetris_reach_input[TETRIS_REACH_STATES];
+static int16_t tetris_reach_queue[TETRIS_REACH_STATES];
+
+//LEFT, DOWN and RIGHT as state index steps, UP goes through the kick table instead
+static const int16_t tetris_reach_step[BUTTON_COUNT] = {
+    [BUTTON_LEFT] = -1, [BUTTON_DOWN] = -TETRIS_MAP_WIDTH, [BUTTON_UP] = 0, [BUTTON_RIGHT] = 1,
+};
+
+//wall kicks, offsets tried in order when a clockwise rotation does not fit where the block is,
+//dy > 0 lifts the block off the floor or the stack. a list only holds offsets the rotations using it
+//can end up taking, an offset that always has an earlier one fitting too is left out
+typedef struct tetris_kick
+{
+    signed char dx, dy;
+} tetris_kick;
+
+typedef struct tetris_kick_list
+{
+    short int count;
+    tetris_kick offsets[7];
+} tetris_kick_list;
+
+static const tetris_kick_list tetris_kicks_none = {1, {{0, 0}}};
+static const tetris_kick_list tetris_kicks_small = {4, {{0, 0}, {-1, 0}, {1, 0}, {0, 1}}};
+static const tetris_kick_list tetris_kicks_small_no_right = {3, {{0, 0}, {-1, 0}, {0, 1}}};
+static const tetris_kick_list tetris_kicks_small_no_left = {3, {{0, 0}, {1, 0}, {0, 1}}};
+static const tetris_kick_list tetris_kicks_small_no_up = {3, {{0, 0}, {-1, 0}, {1, 0}}};
+static const tetris_kick_list tetris_kicks_three = {6, {{0, 0}, {-1, 0}, {1, 0}, {0, 1}, {-1, 1}, {1, 1}}};
+static const tetris_kick_list tetris_kicks_three_no_right = {5, {{0, 0}, {-1, 0}, {0, 1}, {-1, 1}, {1, 1}}};
+static const tetris_kick_list tetris_kicks_three_no_left = {5, {{0, 0}, {1, 0}, {0, 1}, {-1, 1}, {1, 1}}};
+static const tetris_kick_list tetris_kicks_long_up = {6, {{0, 0}, {0, 1}, {0, 2}, {-1, 0}, {1, 0}, {0, 3}}};
+static const tetris_kick_list tetris_kicks_long_down = {6, {{0, 0}, {-1, 0}, {1, 0}, {-2, 0}, {0, 1}, {-1, 1}}};
+
+//indexed by block id and the rotation the block turns from
+static const tetris_kick_list *const tetris_kicks[TETRIS_NUMBER_OF_BLOCKS][4] = {
+    [0] = {[NO_ROTATION] = &tetris_kicks_none, [RIGHT_90] = &tetris_kicks_none,
+        [UPSIDE_DOWN] = &tetris_kicks_none, [LEFT_90] = &tetris_kicks_none},
+    [1] = {[NO_ROTATION] = &tetris_kicks_none, [RIGHT_90] = &tetris_kicks_none,
+        [UPSIDE_DOWN] = &tetris_kicks_none, [LEFT_90] = &tetris_kicks_none},
+    [2] = {[NO_ROTATION] = &tetris_kicks_small_no_right, [RIGHT_90] = &tetris_kicks_small,
+        [UPSIDE_DOWN] = &tetris_kicks_small_no_left, [LEFT_90] = &tetris_kicks_small_no_up},
+    [3] = {[NO_ROTATION] = &tetris_kicks_three, [RIGHT_90] = &tetris_kicks_three_no_right,
+        [UPSIDE_DOWN] = &tetris_kicks_three, [LEFT_90] = &tetris_kicks_three},
+    [4] = {[NO_ROTATION] = &tetris_kicks_three, [RIGHT_90] = &tetris_kicks_three,
+        [UPSIDE_DOWN] = &tetris_kicks_three, [LEFT_90] = &tetris_kicks_three},
+    [5] = {[NO_ROTATION] = &tetris_kicks_three, [RIGHT_90] = &tetris_kicks_three,
+        [UPSIDE_DOWN] = &tetris_kicks_three, [LEFT_90] = &tetris_kicks_three},
+    [6] = {[NO_ROTATION] = &tetris_kicks_three, [RIGHT_90] = &tetris_kicks_three,
+        [UPSIDE_DOWN] = &tetris_kicks_three, [LEFT_90] = &tetris_kicks_three_no_left},
+    [7] = {[NO_ROTATION] = &tetris_kicks_three, [RIGHT_90] = &tetris_kicks_three,
+        [UPSIDE_DOWN] = &tetris_kicks_three, [LEFT_90] = &tetris_kicks_three},
+    //the long block turns upright needing 3 rows below it and lies down needing 2 columns right of it
+    [8] = {[NO_ROTATION] = &tetris_kicks_long_up, [RIGHT_90] = &tetris_kicks_long_down,
+        [UPSIDE_DOWN] = &tetris_kicks_long_up, [LEFT_90] = &tetris_kicks_long_down},
+};
+
+//one finished game, appended to the flash journal
+typedef struct stats_record
+{
+    uint32_t seq;
+    int score, lines, pieces;
+    uint32_t play_time_ms;
+    uint32_t checksum;
+} stats_record;
+
+//lifetime totals, the compacted base is this struct with last_seq telling which journal records it already holds
+typedef struct stats_summary
+{
+    uint32_t last_seq;
+    int top_scores[STATS_TOP_SCORES];
+    uint32_t games, lines, pieces;
+    uint64_t play_time_ms;
+    uint32_t checksum;
+} stats_summary;
+
+static nvs_handle_t stats_nvs;
+static bool stats_ready = false;
+static stats_summary tetris_stats;
+static uint32_t stats_base_seq = 0;
+static int stats_flash_writes = 0;
+
+uint32_t stats_checksum(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
 }
 
-void init_buttons()
+void stats_apply(stats_summary *summary, const stats_record *record)
 {
-    int buttons[] = {LEFT_BUTTON, DOWN_BUTTON, UP_BUTTON, RIGHT_BUTTON};
-    for(int i = 0; i < sizeof(buttons)/sizeof(buttons[0]); i++)
+    int score = record->score;
+    for(int i = 0; i < STATS_TOP_SCORES; i++)
     {
-        gpio_reset_pin(buttons[i]);
-        gpio_set_direction(buttons[i], GPIO_MODE_INPUT);
-        gpio_pullup_dis(buttons[i]);
-        gpio_pulldown_en(buttons[i]);
+        if(score > summary->top_scores[i])
+        {
+            int pushed = summary->top_scores[i];
+            summary->top_scores[i] = score;
+            score = pushed;
+        }
     }
+    summary->games++;
+    summary->lines += record->lines;
+    summary->pieces += record->pieces;
+    summary->play_time_ms += record->play_time_ms;
+    summary->last_seq = record->seq;
 }
 
-void init_display()
+bool stats_write_blob(const char *key, const void *data, size_t size)
 {
-    u8g2_esp32_hal.bus.i2c.sda = PIN_SDA;
-    u8g2_esp32_hal.bus.i2c.scl = PIN_SCL;
-    u8g2_esp32_hal_init(u8g2_esp32_hal);
+    stats_flash_writes++;
+    if(nvs_set_blob(stats_nvs, key, data, size) != ESP_OK || nvs_commit(stats_nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "stats: writing %s failed", key);
+        return false;
+    }
+    return true;
+}
 
+//folds the journal into the base, old records stay in flash but are skipped because their seq is covered
+void stats_write_base()
+{
+    tetris_stats.checksum = stats_checksum(&tetris_stats, offsetof(stats_summary, checksum));
+    if(stats_write_blob("base", &tetris_stats, sizeof(tetris_stats)))
+        stats_base_seq = tetris_stats.last_seq;
+}
 
-    u8g2_Setup_sh1106_i2c_128x64_noname_f(&u8g2, U8G2_R0,
-        u8g2_esp32_i2c_byte_cb,
-        u8g2_esp32_gpio_and_delay_cb); 
-    
-    u8x8_SetI2CAddress(&u8g2.u8x8, 0x78);
-    u8g2_InitDisplay(&u8g2);  // initialize display, display is in sleep mode after this
-    u8g2_SetPowerSave(&u8g2, 0);  // wake up display
-    u8g2_ClearBuffer(&u8g2);
-    u8g2_SendBuffer(&u8g2);
+//base plus every journal record newer than it, a torn or stale record is simply ignored
+void stats_load()
+{
+    esp_err_t err = nvs_flash_init();
+    if(err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+    if(err != ESP_OK || nvs_open(STATS_NAMESPACE, NVS_READWRITE, &stats_nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "stats: nvs unavailable, scores will not be kept");
+        return;
+    }
+    stats_ready = true;
+
+    size_t size = sizeof(tetris_stats);
+    if(nvs_get_blob(stats_nvs, "base", &tetris_stats, &size) != ESP_OK || size != sizeof(tetris_stats) ||
+        tetris_stats.checksum != stats_checksum(&tetris_stats, offsetof(stats_summary, checksum)))
+        memset(&tetris_stats, 0, sizeof(tetris_stats));
+    stats_base_seq = tetris_stats.last_seq;
+
+    //records are written to slot seq - base - 1, so replaying slots in order replays them in seq order
+    char key[16];
+    stats_record record;
+    for(int slot = 0; slot < STATS_JOURNAL_SLOTS; slot++)
+    {
+        snprintf(key, sizeof(key), "j%d", slot);
+        size = sizeof(record);
+        if(nvs_get_blob(stats_nvs, key, &record, &size) != ESP_OK || size != sizeof(record) ||
+            record.checksum != stats_checksum(&record, offsetof(stats_record, checksum)) ||
+            record.seq != tetris_stats.last_seq + 1)
+            break;
+        stats_apply(&tetris_stats, &record);
+    }
+
+    tetris_highscore = tetris_stats.top_scores[0];
+    ESP_LOGI(TAG, "stats: %u games, %u lines, %u pieces, %u s played, best %d",
+        (unsigned)tetris_stats.games, (unsigned)tetris_stats.lines, (unsigned)tetris_stats.pieces,
+        (unsigned)(tetris_stats.play_time_ms / 1000), tetris_stats.top_scores[0]);
 }
 
+void stats_save_game(int score, int lines, int pieces, uint32_t play_time_ms)
+{
+    stats_record record = {
+        .seq = tetris_stats.last_seq + 1, .score = score, .lines = lines,
+        .pieces = pieces, .play_time_ms = play_time_ms
+    };
+    record.checksum = stats_checksum(&record, offsetof(stats_record, checksum));
+    stats_apply(&tetris_stats, &record);
+    if(!stats_ready)
+        return;
+
+    //a full journal is compacted instead of journaling, the base already holds this game, so it is still one write
+    int writes = stats_flash_writes;
+    int slot = record.seq - stats_base_seq - 1;
+    if(slot >= STATS_JOURNAL_SLOTS)
+        stats_write_base();
+    else
+    {
+        char key[16];   //nvs keys are at most 15 characters
+        snprintf(key, sizeof(key), "j%d", slot);
+        stats_write_blob(key, &record, sizeof(record));
+    }
+    ESP_LOGI(TAG, "stats: game saved with %d flash write(s), %d since boot",
+        stats_flash_writes - writes, stats_flash_writes);
+}
 void tetris_shift_rows_down(short int starting_row, short int amount)
 {
     for(int row = starting_row; row < TETRIS_MAP_HEIGHT - amount; row++)
@@ -89,54 +347,43 @@ void tetris_shift_rows_down(short int starting_row, short int amount)
     }
 }
 
-void tetris_start_screen()
+//centered "label number" line, the number uses the double size digit blitter
+void tetris_draw_labeled_number(const char *label, int value, short int y)
 {
-    u8g2_ClearBuffer(&u8g2);
-
-    u8g2_SetFont(&u8g2, u8g2_font_logisoso32_tr);
-    const char *title = "Tetris";
-    short int title_width = u8g2_GetStrWidth(&u8g2, title);
-    short int title_x = (DISPLAY_WIDTH - title_width) / 2;
-    u8g2_DrawStr(&u8g2, title_x, 42, title);
-
-    u8g2_SetFont(&u8g2, u8g2_font_5x7_tr);
-    const char *prompt = "Press any button to play";
-    short int prompt_width = u8g2_GetStrWidth(&u8g2, prompt);
-    short int prompt_x = (DISPLAY_WIDTH - prompt_width) / 2;
-    u8g2_DrawStr(&u8g2, prompt_x, 60, prompt);
+    short int label_width = u8g2_GetStrWidth(&u8g2, label);
+    short int number_width = display_number_width(value, 2);
+    short int x = (DISPLAY_WIDTH - label_width - 6 - number_width) / 2;
+    u8g2_DrawStr(&u8g2, x, y, label);
+    display_draw_number(x + label_width + 6 + number_width, y - 2*DISPLAY_DIGIT_HEIGHT, value, 2);
+}
 
-    u8g2_SendBuffer(&u8g2);
+//an end screen option, framed while it is the one UP/DOWN would take
+void tetris_draw_choice(const char *label, short int x, bool selected)
+{
+    u8g2_DrawStr(&u8g2, x, 60, label);
+    if(selected)
+        u8g2_DrawFrame(&u8g2, x - 2, 51, u8g2_GetStrWidth(&u8g2, label) + 4, 11);
 }
 
-void tetris_end_screen(int score)
+void tetris_render_end_screen(console_choice choice)
 {
-    u8g2_ClearBuffer(&u8g2);
+    int score = tetris.score;
+    int best = tetris.previous_highscore;
 
     u8g2_SetFont(&u8g2, u8g2_font_helvB10_tr);
-    const char *msg = (score > tetris_highscore) ? "New High Score!" : "Game Over";
+    const char *msg = (score > best) ? "New High Score!" : "Game Over";
     int msg_x = (DISPLAY_WIDTH - u8g2_GetStrWidth(&u8g2, msg)) / 2 - 2;
     u8g2_DrawStr(&u8g2, msg_x, 16, msg);
 
-    char buf[32];
     u8g2_SetFont(&u8g2, u8g2_font_6x10_tr);
-    snprintf(buf, sizeof(buf), "Score: %d", score);
-    int score_x = (DISPLAY_WIDTH - u8g2_GetStrWidth(&u8g2, buf)) / 2;
-    u8g2_DrawStr(&u8g2, score_x, 32, buf);
-
-    if (score <= tetris_highscore) {
-        snprintf(buf, sizeof(buf), "Best: %d", tetris_highscore);
-        int best_x = (DISPLAY_WIDTH - u8g2_GetStrWidth(&u8g2, buf)) / 2;
-        u8g2_DrawStr(&u8g2, best_x, 44, buf);
-    }
+    tetris_draw_labeled_number("Score:", score, 32);
+
+    if (score <= best)
+        tetris_draw_labeled_number("Best:", best, 44);
     
     u8g2_SetFont(&u8g2, u8g2_font_5x8_tr);
-    u8g2_DrawStr(&u8g2, 5, 60, "Play Again");
-    u8g2_DrawStr(&u8g2, 95, 60, "Exit");
-
-    u8g2_SendBuffer(&u8g2);
-
-    if (score > tetris_highscore)
-        tetris_highscore = score;
+    tetris_draw_choice("Play Again", 5, choice == CHOICE_PLAY_AGAIN);
+    tetris_draw_choice("Exit", 95, choice == CHOICE_EXIT);
 }
 
 void tetris_draw_frame()
@@ -167,10 +414,11 @@ void tetris_draw_blocks()
     }
 }
 
-void tetris_draw_active_block(short int map_x, short int map_y, short int id, block_rotation rotation)
+//fall_px moves the block down by part of a cell, collision never sees it
+void tetris_draw_active_block(short int map_x, short int map_y, short int id, block_rotation rotation, short int fall_px)
 {
     short int x_offset = DISPLAY_WIDTH/2 + 1;
-    short int y_offset = (DISPLAY_HEIGHT - TETRIS_BLOCK_SIZE*TETRIS_MAP_HEIGHT - 2)/2 + 1;
+    short int y_offset = (DISPLAY_HEIGHT - TETRIS_BLOCK_SIZE*TETRIS_MAP_HEIGHT - 2)/2 + 1 - fall_px;
     switch(id)
     {
         case 0: //single block
@@ -389,30 +637,25 @@ void tetris_draw_active_block(short int map_x, short int map_y, short int id, bl
     }
 }
 
-void tetris_draw_background(int score, short int speed, short int next_id)
+void tetris_draw_background(int score, short int level, short int next_id)
 {
     u8g2_SetFont(&u8g2, u8g2_font_4x6_tf);
 
-    char buf[16];
     const int ui_x = 40;
     int y = 6;
 
     // --- SCORE ---
     u8g2_DrawStr(&u8g2, ui_x, y, "SCORE");
-    snprintf(buf, sizeof(buf), "%d", score);
     y += 7;
     u8g2_DrawFrame(&u8g2, ui_x, y - 6, 19, 9);
-    int score_width = u8g2_GetStrWidth(&u8g2, buf);
-    u8g2_DrawStr(&u8g2, ui_x + 19 - score_width - 2, y + 1, buf);
+    display_draw_number(ui_x + 17, y + 1 - DISPLAY_DIGIT_HEIGHT, score, 1);
     y += 11;
 
-    // --- SPEED ---
-    u8g2_DrawStr(&u8g2, ui_x, y, "SPEED");
-    snprintf(buf, sizeof(buf), "%d", speed);
+    // --- LEVEL ---
+    u8g2_DrawStr(&u8g2, ui_x, y, "LEVEL");
     y += 7;
     u8g2_DrawFrame(&u8g2, ui_x, y - 6, 19, 9);
-    int speed_width = u8g2_GetStrWidth(&u8g2, buf);
-    u8g2_DrawStr(&u8g2, ui_x + 19 - speed_width - 2, y + 1, buf);
+    display_draw_number(ui_x + 17, y + 1 - DISPLAY_DIGIT_HEIGHT, level, 1);
     y += 17;
 
     // --- NEXT Block ---
@@ -467,35 +710,11 @@ void tetris_draw_background(int score, short int speed, short int next_id)
     }
 }
 
-void tetris_draw_row_deletion(short int row, short int count, int score, short int speed, short int next_id)
-{
-    if(row == -1)
-        return;
-
-    for(int i = 0; i < TETRIS_MAP_WIDTH/2; i++)
-    {
-        for(int j = 0; j < count; j++)
-        {
-            tetris_map[row + j][TETRIS_MAP_WIDTH/2 + i] = false;
-            tetris_map[row + j][TETRIS_MAP_WIDTH/2 - 1 - i] = false;
-        }
-        u8g2_ClearBuffer(&u8g2);
-        tetris_draw_background(score, speed, next_id);
-        tetris_draw_frame();
-        tetris_draw_blocks();
-        u8g2_SendBuffer(&u8g2);
-    }
-
-    tetris_shift_rows_down(row, count);
-    u8g2_ClearBuffer(&u8g2);
-    tetris_draw_background(score, speed, next_id);
-    tetris_draw_frame();
-    tetris_draw_blocks();
-    u8g2_SendBuffer(&u8g2);
-}
-
 bool tetris_block_fits(short int map_x, short int map_y, short int id, block_rotation rotation)
 {
+    //every block hangs down from its anchor row, so only the anchor can be above the map
+    if(map_y >= TETRIS_MAP_HEIGHT)
+        return false;
     switch(id)
     {
         case 0: //signle block
@@ -885,7 +1104,8 @@ void tetris_deactivate_block(short int map_x, short int map_y, short int id, blo
     }
 }
 
-int tetris_check_row_completion(short int* score_multiplier, int score, short int speed, short int next_id)
+//returns the lowest completed row and how many completed rows follow it, -1 if there is none
+short int tetris_find_completed_rows(short int *count)
 {
     short int consecutive_rows = 1;
     short int starting_row = -1;
@@ -913,16 +1133,14 @@ int tetris_check_row_completion(short int* score_multiplier, int score, short in
             starting_row = row;
     }
 
-    tetris_draw_row_deletion(starting_row, consecutive_rows, score, speed, next_id);
-    
-    if(starting_row == -1)
-    {
-        *score_multiplier = 0;
-        return 0;
-    }
+    *count = consecutive_rows;
+    return starting_row;
+}
 
+int tetris_score_rows(short int* score_multiplier, short int count)
+{
     (*score_multiplier)++;
-    switch(consecutive_rows)
+    switch(count)
     {
         case 1:
             return (*score_multiplier) * 100;
@@ -936,137 +1154,638 @@ int tetris_check_row_completion(short int* score_multiplier, int score, short in
     return 0;
 }
 
-void app_main(void)
+block_rotation tetris_rotate_clockwise(block_rotation rotation)
 {
-    init_buttons();
-    init_display();
-    init_low_power_mode();
-    srand(time(0));
-
-    int score, speed_limit;
-    short int block_id, block_x, block_y;
-    short int next_id, next_x, next_y;
-    short int speed, ticks_till_fall, score_multiplier;
-    block_rotation rotation, next_rotation;
-
-    while(true)
+    switch(rotation)
     {
-        //initialize variables
-        score = 0, speed = 1, speed_limit = 2000, score_multiplier = 0;
-        ticks_till_fall = TETRIS_MAX_SPEED + 1 - speed;
-        block_id = rand() % TETRIS_NUMBER_OF_BLOCKS;
-        next_id = rand() % TETRIS_NUMBER_OF_BLOCKS;
-        block_x = TETRIS_MAP_WIDTH / 2 - 1;
-        block_y = TETRIS_MAP_HEIGHT - 1;
-        rotation = NO_ROTATION;
-        next_x = block_x, next_y = block_y, next_rotation = rotation;
-        memset(tetris_map, 0, sizeof(tetris_map));
-        
-        tetris_start_screen();
+        case NO_ROTATION:
+            return RIGHT_90;
+        case RIGHT_90:
+            return UPSIDE_DOWN;
+        case UPSIDE_DOWN:
+            return LEFT_90;
+        case LEFT_90:
+            return NO_ROTATION;
+    }
+    return NO_ROTATION;
+}
 
-        //wait for button press to start the game
-        esp_light_sleep_start();
+//first kick offset that lets the block turn clockwise, NULL if none does
+const tetris_kick *tetris_find_kick(short int map_x, short int map_y, short int id, block_rotation rotation)
+{
+    const tetris_kick_list *kicks = tetris_kicks[id][rotation];
+    block_rotation turned = tetris_rotate_clockwise(rotation);
+    for(int i = 0; i < kicks->count; i++)
+        if(tetris_block_fits(map_x + kicks->offsets[i].dx, map_y + kicks->offsets[i].dy, id, turned))
+            return &kicks->offsets[i];
+    return NULL;
+}
 
-        //main game loop
-        while(true)
-        {
-            u8g2_ClearBuffer(&u8g2);
-
-            //process user inupt
-            if(gpio_get_level(DOWN_BUTTON))
-                next_y = block_y - 1;
-            if(gpio_get_level(LEFT_BUTTON))
-                next_x = block_x - 1;
-            if(gpio_get_level(RIGHT_BUTTON))
-                next_x = block_x + 1;
-            if(gpio_get_level(UP_BUTTON))
-                switch(rotation)
+#define TETRIS_REACH_BIT(set, state) ((set)[(state) >> 5] & (1u << ((state) & 31)))
+
+short int tetris_reach_state(short int map_x, short int map_y, block_rotation rotation)
+{
+    return (rotation * TETRIS_MAP_HEIGHT + map_y) * TETRIS_MAP_WIDTH + map_x;
+}
+
+//breadth first over button presses from the given anchor, so the first visit of a state is the
+//shortest way there. gravity is assumed slower than the inputs. writes every state the block would
+//lock in to locks, at most TETRIS_REACH_STATES of them, and returns how many
+short int tetris_reach_search(short int id, short int map_x, short int map_y, block_rotation rotation, int16_t *locks)
+{
+    //which anchors fit on this board, one block_fits per state up front
+    memset(tetris_reach_fits, 0, sizeof(tetris_reach_fits));
+    memset(tetris_reach_visited, 0, sizeof(tetris_reach_visited));
+    for(short int r = 0; r < 4; r++)
+        for(short int y = 0; y < TETRIS_MAP_HEIGHT; y++)
+            for(short int x = 0; x < TETRIS_MAP_WIDTH; x++)
+                if(tetris_block_fits(x, y, id, (block_rotation)r))
                 {
-                    case NO_ROTATION:
-                        next_rotation = RIGHT_90; break;
-                    case RIGHT_90:
-                        next_rotation = UPSIDE_DOWN; break;
-                    case UPSIDE_DOWN:
-                        next_rotation = LEFT_90; break;
-                    case LEFT_90:
-                        next_rotation = NO_ROTATION; break;
+                    short int state = tetris_reach_state(x, y, (block_rotation)r);
+                    tetris_reach_fits[state >> 5] |= 1u << (state & 31);
                 }
 
-            if(block_id == -1)
+    short int start = tetris_reach_state(map_x, map_y, rotation);
+    if(!TETRIS_REACH_BIT(tetris_reach_fits, start))
+        return 0;
+
+    short int head = 0, tail = 0, count = 0;
+    tetris_reach_queue[tail++] = start;
+    tetris_reach_visited[start >> 5] |= 1u << (start & 31);
+    tetris_reach_parent[start] = -1;
+    while(head < tail)
+    {
+        short int state = tetris_reach_queue[head++];
+        short int x = state % TETRIS_MAP_WIDTH;
+        short int y = state / TETRIS_MAP_WIDTH % TETRIS_MAP_HEIGHT;
+        block_rotation r = (block_rotation)(state / (TETRIS_MAP_WIDTH * TETRIS_MAP_HEIGHT));
+
+        if(y == 0 || !TETRIS_REACH_BIT(tetris_reach_fits, state - TETRIS_MAP_WIDTH))
+            locks[count++] = state;
+
+        for(short int b = 0; b < BUTTON_COUNT; b++)
+        {
+            short int next = -1;
+            if(b == BUTTON_UP)
             {
-                block_id = next_id;
-                next_id = rand() % TETRIS_NUMBER_OF_BLOCKS;
-                block_x = TETRIS_MAP_WIDTH / 2 - 1;
-                block_y = TETRIS_MAP_HEIGHT - 1;
-                rotation = NO_ROTATION;
-                next_x = block_x, next_y = block_y, next_rotation = rotation;
-                if(!tetris_block_fits(block_x, block_y, block_id, rotation))
+                //same order as tetris_find_kick, but against the fits bitset, anchors off the map never fit
+                const tetris_kick_list *kicks = tetris_kicks[id][r];
+                block_rotation turned = tetris_rotate_clockwise(r);
+                for(short int i = 0; i < kicks->count && next == -1; i++)
                 {
-                    break;
+                    short int kick_x = x + kicks->offsets[i].dx, kick_y = y + kicks->offsets[i].dy;
+                    if(kick_x < 0 || kick_x >= TETRIS_MAP_WIDTH || kick_y < 0 || kick_y >= TETRIS_MAP_HEIGHT)
+                        continue;
+                    short int kicked = tetris_reach_state(kick_x, kick_y, turned);
+                    if(TETRIS_REACH_BIT(tetris_reach_fits, kicked))
+                        next = kicked;
                 }
+                if(next == -1)
+                    continue;
             }
+            else
+            {
+                if((b == BUTTON_LEFT && x == 0) || (b == BUTTON_RIGHT && x == TETRIS_MAP_WIDTH - 1) || (b == BUTTON_DOWN && y == 0))
+                    continue;
+                next = state + tetris_reach_step[b];
+                if(!TETRIS_REACH_BIT(tetris_reach_fits, next))
+                    continue;
+            }
+            if(TETRIS_REACH_BIT(tetris_reach_visited, next))
+                continue;
+            tetris_reach_visited[next >> 5] |= 1u << (next & 31);
+            tetris_reach_parent[next] = state;
+            tetris_reach_input[next] = b;
+            tetris_reach_queue[tail++] = next;
+        }
+    }
+    return count;
+}
 
-            ticks_till_fall--;
-            if(ticks_till_fall == 0)
+//the shortest button sequence to a state found by the last search, returns its length or -1 if it
+//does not fit in max_inputs
+short int tetris_reach_path(short int state, console_button *inputs, short int max_inputs)
+{
+    short int length = 0;
+    for(short int s = state; tetris_reach_parent[s] != -1; s = tetris_reach_parent[s])
+        length++;
+    if(length > max_inputs)
+        return -1;
+    for(short int s = state, i = length - 1; i >= 0; s = tetris_reach_parent[s], i--)
+        inputs[i] = (console_button)tetris_reach_input[s];
+    return length;
+}
+
+//reachability searches per second for every block from its spawn point on a ragged board
+void tetris_benchmark_reach()
+{
+    const int runs = 10;
+    static int16_t locks[TETRIS_REACH_STATES];
+    console_button inputs[64];
+    int searches = 0, placements = 0, paths = 0, inputs_total = 0;
+    for(int y = 0; y < TETRIS_MAP_HEIGHT; y++)
+        for(int x = 0; x < TETRIS_MAP_WIDTH; x++)
+            tetris_map[y][x] = y < TETRIS_MAP_HEIGHT/3 + (x * 5 + 3) % 4 && (x * 7 + y * 3) % 5 != 0;
+
+    int64_t start_us = esp_timer_get_time();
+    for(int i = 0; i < runs; i++)
+        for(short int id = 0; id < TETRIS_NUMBER_OF_BLOCKS; id++)
+        {
+            short int count = tetris_reach_search(id, TETRIS_MAP_WIDTH / 2 - 1, TETRIS_MAP_HEIGHT - 1, NO_ROTATION, locks);
+            searches++;
+            placements += count;
+            for(short int j = 0; j < count && i == 0; j++)
             {
-                if(score >= speed_limit && speed_limit != -1)
+                short int length = tetris_reach_path(locks[j], inputs, 64);
+                if(length >= 0)
+                    inputs_total += length, paths++;
+            }
+        }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    memset(tetris_map, 0, sizeof(tetris_map));
+    ESP_LOGI(TAG, "reach: %d searches in %d us, %d per second, %d placements per search, %d inputs per placement",
+        searches, (int)elapsed_us, (int)(searches * 1000000LL / (elapsed_us > 0 ? elapsed_us : 1)),
+        placements / searches, paths > 0 ? inputs_total / paths : 0);
+}
+
+//kicked rotations per second on a half filled board, runs once before the first game in TETRIS_BENCHMARKS builds
+void tetris_benchmark_kicks()
+{
+    const int runs = 20;
+    int rotations = 0, kicked = 0;
+    for(int y = 0; y < TETRIS_MAP_HEIGHT; y++)
+        for(int x = 0; x < TETRIS_MAP_WIDTH; x++)
+            tetris_map[y][x] = y < TETRIS_MAP_HEIGHT/2 && (x * 7 + y * 3) % 4 == 0;
+
+    int64_t start_us = esp_timer_get_time();
+    for(int i = 0; i < runs; i++)
+        for(short int id = 0; id < TETRIS_NUMBER_OF_BLOCKS; id++)
+            for(short int x = 0; x < TETRIS_MAP_WIDTH; x++)
+                for(short int y = 0; y < TETRIS_MAP_HEIGHT; y++)
                 {
-                    speed++;
-                    switch(speed)
-                    {
-                        case 2:
-                            speed_limit = 4000; break;
-                        case 3:
-                            speed_limit = 10000; break;
-                        case 4:
-                            speed_limit = 20000; break;
-                        case 5:
-                            speed_limit = -1; break;
-                    }
+                    const tetris_kick *kick = tetris_find_kick(x, y, id, (block_rotation)((x + y) % 4));
+                    rotations++;
+                    if(kick != NULL && (kick->dx != 0 || kick->dy != 0))
+                        kicked++;
                 }
-                ticks_till_fall = TETRIS_MAX_SPEED + 1 - speed;
-                if(next_y == block_y)
-                    next_y--;
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    memset(tetris_map, 0, sizeof(tetris_map));
+    ESP_LOGI(TAG, "rotation: %d kick searches in %d us, %d per second, %d kicked",
+        rotations, (int)elapsed_us, (int)(rotations * 1000000LL / (elapsed_us > 0 ? elapsed_us : 1)), kicked / runs);
+}
+
+//how far into the next row the active block has fallen by now_us, in pixels, while it has a row to fall into
+short int tetris_fall_pixels(int64_t now_us)
+{
+    if(tetris.block_id == -1 || !tetris_block_fits(tetris.block_x, tetris.block_y - 1, tetris.block_id, tetris.rotation))
+        return 0;
+    int64_t progress = tetris.fall_progress + (int64_t)tetris_levels[tetris.level].gravity * (now_us - tetris.fall_updated_us);
+    if(progress >= TETRIS_FALL_ROW)
+        return TETRIS_BLOCK_SIZE - 1;
+    return progress * TETRIS_BLOCK_SIZE / TETRIS_FALL_ROW;
+}
+
+void tetris_render(const void *ctx)
+{
+    const console_frame *frame = ctx;
+    if(tetris.phase == TETRIS_OVER)
+    {
+        tetris_render_end_screen(frame->choice);
+        return;
+    }
+    if(tetris.phase == TETRIS_PLAYING)
+        tetris_draw_active_block(tetris.block_x, tetris.block_y, tetris.block_id, tetris.rotation, tetris_fall_pixels(frame->now_us));
+    tetris_draw_background(tetris.score, tetris.level + 1, tetris.next_id);
+    tetris_draw_frame();
+    tetris_draw_blocks();
+}
+
+void tetris_spawn_block(short int id, int64_t now_us)
+{
+    tetris.block_id = id;
+    tetris.block_x = TETRIS_MAP_WIDTH / 2 - 1;
+    tetris.block_y = TETRIS_MAP_HEIGHT - 1;
+    tetris.rotation = NO_ROTATION;
+    tetris.lowest_y = tetris.block_y;
+    tetris.lock_started_us = -1, tetris.lock_resets = 0;
+    tetris.piece_started_us = now_us, tetris.soft_drop_rows = 0;
+    tetris.fall_updated_us = tetris.piece_started_us, tetris.fall_progress = 0;
+}
+
+//how far the active block can fall, at most max_rows
+short int tetris_drop_distance(short int max_rows)
+{
+    short int rows = 0;
+    while(rows < max_rows && tetris_block_fits(tetris.block_x, tetris.block_y - rows - 1, tetris.block_id, tetris.rotation))
+        rows++;
+    return rows;
+}
+
+//soak games are not played by anyone, keep them out of the gameplay histograms
+void tetris_record_event(telemetry_event_type type, uint8_t value, uint16_t extra, uint32_t arg)
+{
+    if(!tetris_soaking)
+        telemetry_record(type, value, extra, arg);
+}
+
+void tetris_update_level()
+{
+    while(tetris.level + 1 < TETRIS_NUMBER_OF_LEVELS
+        && (tetris.score >= tetris_levels[tetris.level + 1].score || tetris.lines >= tetris_levels[tetris.level + 1].lines))
+    {
+        tetris.level++;
+        tetris_record_event(TELEMETRY_LEVEL_CHANGED, tetris.level + 1, 0, 0);
+    }
+}
+
+//a fresh board and the first block
+void tetris_reset()
+{
+    memset(&tetris, 0, sizeof(tetris));
+    memset(tetris_map, 0, sizeof(tetris_map));
+    tetris.phase = TETRIS_PLAYING;
+    tetris.next_id = rand() % TETRIS_NUMBER_OF_BLOCKS;
+    tetris.started_us = esp_timer_get_time();
+    tetris_spawn_block(rand() % TETRIS_NUMBER_OF_BLOCKS, tetris.started_us);
+}
+
+//moves and rotations happen right away, gravity and locking wait for the tick
+void tetris_on_input(const console_input *input)
+{
+    if(tetris.phase != TETRIS_PLAYING || tetris.block_id == -1)
+        return;
+
+    short int id = tetris.block_id;
+    short int x = tetris.block_x, y = tetris.block_y;
+    block_rotation rotation = tetris.rotation;
+    for(int i = 0; i < input->steps[BUTTON_LEFT] && tetris_block_fits(tetris.block_x - 1, tetris.block_y, id, tetris.rotation); i++)
+        tetris.block_x--, tetris.moved = true;
+    for(int i = 0; i < input->steps[BUTTON_RIGHT] && tetris_block_fits(tetris.block_x + 1, tetris.block_y, id, tetris.rotation); i++)
+        tetris.block_x++, tetris.moved = true;
+    const tetris_kick *kick = input->steps[BUTTON_UP] ? tetris_find_kick(tetris.block_x, tetris.block_y, id, tetris.rotation) : NULL;
+    if(kick != NULL)
+    {
+        tetris.block_x += kick->dx, tetris.block_y += kick->dy;
+        tetris.rotation = tetris_rotate_clockwise(tetris.rotation), tetris.moved = true;
+    }
+
+    //several frames can run before the next tick, a soft drop latched in an earlier one
+    //no longer holds once the block has left the spot it was pressed down on
+    if(tetris.block_x != x || tetris.block_y != y || tetris.rotation != rotation)
+        tetris.soft_drop_lock = false;
+
+    //soft drop onto the stack locks right away
+    for(int i = 0; i < input->steps[BUTTON_DOWN] && !tetris.soft_drop_lock; i++)
+    {
+        if(tetris_block_fits(tetris.block_x, tetris.block_y - 1, id, tetris.rotation))
+            tetris.block_y--, tetris.soft_drop_rows++;
+        else
+            tetris.soft_drop_lock = true;
+    }
+}
+
+//snapshot of the board and the placement just before the block locks
+void tetris_sample_begin()
+{
+    for(int y = 0; y < TETRIS_MAP_HEIGHT; y++)
+    {
+        tetris_sample.rows[y] = 0;
+        for(int x = 0; x < TETRIS_MAP_WIDTH; x++)
+            tetris_sample.rows[y] |= tetris_map[y][x] << x;
+    }
+    tetris_sample.block_id = tetris.block_id, tetris_sample.next_id = tetris.next_id;
+    tetris_sample.block_x = tetris.block_x, tetris_sample.rotation = tetris.rotation;
+    tetris_sample_score = tetris.score, tetris_sample_lines = tetris.lines;
+}
+
+void tetris_sample_end()
+{
+    tetris_sample.lines = tetris.lines - tetris_sample_lines;
+    tetris_sample.score_delta = tetris.score - tetris_sample_score;
+    dataset_record(&tetris_sample);
+}
+
+void tetris_tick_playing(int64_t now_us)
+{
+    if(tetris.block_id == -1)
+    {
+        tetris_spawn_block(tetris.next_id, now_us);
+        tetris.next_id = rand() % TETRIS_NUMBER_OF_BLOCKS;
+        if(!tetris_block_fits(tetris.block_x, tetris.block_y, tetris.block_id, tetris.rotation))
+        {
+            tetris.phase = TETRIS_OVER;
+            return;
+        }
+    }
+
+    //gravity, at high levels several rows per tick, landing in one go
+    tetris.fall_progress += (int64_t)tetris_levels[tetris.level].gravity * (now_us - tetris.fall_updated_us);
+    tetris.fall_updated_us = now_us;
+    short int rows = tetris.fall_progress / TETRIS_FALL_ROW;
+    if(rows > TETRIS_MAP_HEIGHT)
+        rows = TETRIS_MAP_HEIGHT;
+    short int fallen = tetris_drop_distance(rows);
+    tetris.block_y -= fallen;
+    if(fallen < rows)
+        tetris.fall_progress = 0;   //resting on the stack does not bank gravity
+    else
+        tetris.fall_progress -= rows * TETRIS_FALL_ROW;
+
+    //lock delay, started when the piece first rests and kept for the whole piece, so kicking
+    //it back up does not stop the clock. moves and rotations restart it a limited number of
+    //times, only reaching a new lowest row gives the piece a fresh delay and fresh restarts
+    bool resting = !tetris_block_fits(tetris.block_x, tetris.block_y - 1, tetris.block_id, tetris.rotation);
+    bool lock = tetris.soft_drop_lock && resting;
+    if(tetris.block_y < tetris.lowest_y)
+        tetris.lowest_y = tetris.block_y, tetris.lock_started_us = -1, tetris.lock_resets = 0;
+    if(tetris.lock_started_us == -1)
+    {
+        if(resting)
+            tetris.lock_started_us = now_us;
+    }
+    else if(tetris.moved && tetris.lock_resets < TETRIS_LOCK_RESETS)
+        tetris.lock_started_us = now_us, tetris.lock_resets++;
+    if(resting && tetris.lock_started_us != -1 && now_us - tetris.lock_started_us >= TETRIS_LOCK_DELAY_US)
+        lock = true;
+    tetris.moved = false, tetris.soft_drop_lock = false;
+
+    if(lock)
+    {
+        tetris_sample_begin();
+        tetris_deactivate_block(tetris.block_x, tetris.block_y, tetris.block_id, tetris.rotation);
+        tetris_record_event(TELEMETRY_PIECE_PLACED, tetris.block_id, tetris.soft_drop_rows, (now_us - tetris.piece_started_us) / 1000);
+        tetris.block_y = -1, tetris.block_x = -1, tetris.block_id = -1;
+        tetris.pieces++;
+
+        tetris.clear_row = tetris_find_completed_rows(&tetris.clear_count);
+        if(tetris.clear_row == -1)
+        {
+            tetris.score_multiplier = 0;
+            tetris_sample_end();
+        }
+        else
+            tetris.phase = TETRIS_CLEARING, tetris.clear_step = 0;
+    }
+}
+
+//wipes the completed rows from the middle out, one column pair per logic tick, then drops the rows above
+void tetris_tick_clearing()
+{
+    if(tetris.clear_step < TETRIS_MAP_WIDTH/2)
+    {
+        for(int j = 0; j < tetris.clear_count; j++)
+        {
+            tetris_map[tetris.clear_row + j][TETRIS_MAP_WIDTH/2 + tetris.clear_step] = false;
+            tetris_map[tetris.clear_row + j][TETRIS_MAP_WIDTH/2 - 1 - tetris.clear_step] = false;
+        }
+        tetris.clear_step++;
+        return;
+    }
+
+    tetris_shift_rows_down(tetris.clear_row, tetris.clear_count);
+    tetris.lines += tetris.clear_count;
+    tetris_record_event(TELEMETRY_LINES_CLEARED, tetris.clear_count, 0, 0);
+    tetris.score += tetris_score_rows(&tetris.score_multiplier, tetris.clear_count);
+    tetris_update_level();
+
+    //rows completed apart from the cleared run are wiped next instead of staying full
+    tetris.clear_row = tetris_find_completed_rows(&tetris.clear_count);
+    if(tetris.clear_row == -1)
+    {
+        tetris.phase = TETRIS_PLAYING;
+        tetris_sample_end();
+    }
+    else
+        tetris.clear_step = 0;
+}
+
+//what must hold after every tick, logs the first broken rule
+bool tetris_check_invariants()
+{
+    static int last_score = 0;
+    if(tetris.pieces == 0 && tetris.score == 0)
+        last_score = 0;
+    if(tetris.score < last_score)
+    {
+        ESP_LOGE(TAG, "score went down from %d to %d", last_score, tetris.score);
+        return false;
+    }
+    last_score = tetris.score;
+
+    if(tetris.level < 0 || tetris.level >= TETRIS_NUMBER_OF_LEVELS)
+    {
+        ESP_LOGE(TAG, "level %d outside the level table", tetris.level);
+        return false;
+    }
+
+    short int full_rows = 0;
+    for(int row = 0; row < TETRIS_MAP_HEIGHT; row++)
+    {
+        int col = 0;
+        while(col < TETRIS_MAP_WIDTH && tetris_map[row][col])
+            col++;
+        full_rows += col == TETRIS_MAP_WIDTH;
+    }
+
+    switch(tetris.phase)
+    {
+        case TETRIS_PLAYING:
+            if(full_rows != 0)
+            {
+                ESP_LOGE(TAG, "%d full rows left on the board", full_rows);
+                return false;
+            }
+            if(tetris.block_id != -1 && !tetris_block_fits(tetris.block_x, tetris.block_y, tetris.block_id, tetris.rotation))
+            {
+                ESP_LOGE(TAG, "block %d at %d,%d overlaps the board", tetris.block_id, tetris.block_x, tetris.block_y);
+                return false;
+            }
+            break;
+        case TETRIS_CLEARING:
+            if(tetris.clear_count < 1 || tetris.clear_count > 4 || tetris.clear_row < 0
+                || tetris.clear_row + tetris.clear_count > TETRIS_MAP_HEIGHT)
+            {
+                ESP_LOGE(TAG, "clearing %d rows from row %d", tetris.clear_count, tetris.clear_row);
+                return false;
             }
+            break;
+        case TETRIS_OVER:
+            break;
+    }
+    return true;
+}
+
+bool tetris_tick(int64_t now_us)
+{
+    switch(tetris.phase)
+    {
+        case TETRIS_PLAYING:
+            tetris_tick_playing(now_us);
+            break;
+        case TETRIS_CLEARING:
+            tetris_tick_clearing();
+            break;
+        case TETRIS_OVER:
+            break;
+    }
+#if TETRIS_CHECK_INVARIANTS
+    if(!tetris_check_invariants())
+        ESP_LOGE(TAG, "board invariant broken at %d pieces", tetris.pieces);
+#endif
+    if(tetris.phase != TETRIS_OVER)
+        return true;
+    if(tetris_soaking)
+        return false;
+
+    //remember the old best for the end screen, the game is written to flash later by tetris_save
+    tetris.ended_us = now_us;
+    tetris.previous_highscore = tetris_highscore;
+    if(tetris.score > tetris_highscore)
+        tetris_highscore = tetris.score;
+    return false;
+}
+
+//the settled board top row first, and where the active block is
+void tetris_log_board()
+{
+    ESP_LOGI(TAG, "phase %d, score %d, pieces %d, block %d at %d,%d rotation %d, lock resets %d",
+        tetris.phase, tetris.score, tetris.pieces, tetris.block_id, tetris.block_x, tetris.block_y,
+        tetris.rotation, tetris.lock_resets);
+    for(int y = TETRIS_MAP_HEIGHT - 1; y >= 0; y--)
+    {
+        char row[TETRIS_MAP_WIDTH + 1];
+        for(int x = 0; x < TETRIS_MAP_WIDTH; x++)
+            row[x] = tetris_map[y][x] ? '#' : '.';
+        row[TETRIS_MAP_WIDTH] = 0;
+        ESP_LOGI(TAG, "%2d %s", y, row);
+    }
+}
 
-            if(next_x != block_x)
-                if(tetris_block_fits(next_x, block_y, block_id, rotation))
-                    block_x = next_x;
-            if(next_rotation != rotation)
-                if(tetris_block_fits(block_x, block_y, block_id, next_rotation))
-                    rotation = next_rotation;
-            if(next_y < block_y)
+//drives whole games with random and bursty input at random frame times, stops at the first broken
+//invariant and logs the seed and tick that replay it. every game is seeded on its own, so
+//TETRIS_SOAK_SEED and TETRIS_SOAK_REPLAY_TICK from that log replay just the failing game.
+//returns false if an invariant broke
+bool tetris_soak()
+{
+    if(TETRIS_SOAK_TICKS == 0)
+        return true;
+
+    console_input input;
+    unsigned seed = TETRIS_SOAK_SEED != 0 ? TETRIS_SOAK_SEED : (unsigned)esp_timer_get_time();
+    long long ticks = 0;
+    int games = 0;
+    bool broken = false;
+    tetris_soaking = true;
+
+    int64_t start_us = esp_timer_get_time();
+    while(ticks < TETRIS_SOAK_TICKS && !broken)
+    {
+        srand(seed + games);
+        tetris_reset();
+        int64_t now_us = tetris.started_us;
+        bool running = true;
+        for(long game_ticks = 0; running && !broken && ticks < TETRIS_SOAK_TICKS; game_ticks++)
+        {
+            if(TETRIS_SOAK_REPLAY_TICK > 0 && game_ticks == TETRIS_SOAK_REPLAY_TICK)
+            {
+                tetris_log_board();
+                break;
+            }
+            if(ticks % TETRIS_SOAK_YIELD_TICKS == 0)
+                vTaskDelay(1);
+            //like the console, any number of frames between two ticks, each with its own buttons
+            int64_t tick_us = now_us + 1000 + rand() % 50000;
+            for(int frames = rand() % 4, frame = 1; frame <= frames; frame++)
             {
-                if(tetris_block_fits(block_x, next_y, block_id, rotation))
-                    block_y = next_y;
-                else
+                memset(&input, 0, sizeof(input));
+                input.now_us = now_us + (tick_us - now_us) * frame / (frames + 1);
+                bool burst = rand() % 8 == 0;   //every button at once, several steps each
+                for(int b = 0; b < BUTTON_COUNT; b++)
                 {
-                    tetris_deactivate_block(block_x, block_y, block_id, rotation);
-                    block_y = -1, block_x = -1, block_id = -1;
-                    next_x = -1, next_y = -1;
+                    input.steps[b] = burst ? rand() % 4 : rand() % 4 == 0;
+                    input.held[b] = input.steps[b] > 0;
                 }
+                tetris_on_input(&input);
+            }
+            now_us = tick_us;
+            running = tetris_tick(now_us);
+            ticks++;
+            if(!tetris_check_invariants())
+            {
+                ESP_LOGE(TAG, "soak: seed %u broke at tick %ld of its game", seed + games, game_ticks + 1);
+                tetris_log_board();
+                broken = true;
             }
-            //rollback all unsuccessful states
-            next_x = block_x, next_y = block_y, next_rotation = rotation;
-
-            //render eveything
-            tetris_draw_active_block(block_x, block_y, block_id, rotation);
-            tetris_draw_background(score, speed, next_id);
-            tetris_draw_frame();
-            tetris_draw_blocks();
-            u8g2_SendBuffer(&u8g2);
-
-            //check for completed rows
-            if(block_id == -1)
-                score += tetris_check_row_completion(&score_multiplier, score, speed, next_id);
-            
         }
+        games++;
+        if(TETRIS_SOAK_REPLAY_TICK > 0)
+            break;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
 
-        tetris_end_screen(score);
+    dataset_flush_partial();
+    tetris_soaking = false;
+    ESP_LOGI(TAG, "soak: %lld ticks over %d games in %d ms, %d ticks/s%s", ticks, games, (int)(elapsed_us / 1000),
+        (int)(ticks * 1000000 / (elapsed_us > 0 ? elapsed_us : 1)), broken ? ", invariant broken" : "");
+    return !broken;
+}
 
-        //wait for exit the game or play again button press
-        esp_light_sleep_start();
-        //if(!gpio_get_level(LEFT_BUTTON))
-            //break;
+void tetris_init()
+{
+    static bool stats_loaded = false;
+    if(!stats_loaded)
+    {
+        stats_loaded = true;
+        diagnostics_static("tetris", sizeof(tetris) + sizeof(tetris_map) + sizeof(tetris_stats));
+        diagnostics_static("reach", sizeof(tetris_reach_fits) + sizeof(tetris_reach_visited) + sizeof(tetris_reach_parent)
+            + sizeof(tetris_reach_input) + sizeof(tetris_reach_queue));
+        stats_load();
+        if(TETRIS_BENCHMARKS)
+        {
+            tetris_benchmark_kicks();
+            tetris_benchmark_reach();
+        }
+        tetris_soak();
     }
+    tetris_reset();
 }
+
+size_t tetris_serialize(void *buffer, size_t size)
+{
+    if(size < sizeof(tetris) + sizeof(tetris_map))
+        return 0;
+    memcpy(buffer, &tetris, sizeof(tetris));
+    memcpy((uint8_t *)buffer + sizeof(tetris), tetris_map, sizeof(tetris_map));
+    return sizeof(tetris) + sizeof(tetris_map);
+}
+
+//the runtime calls this once the end screen is up, with the snapshot tetris_serialize made of the finished game.
+//the game's last records go out here too, so a stream cut after it still holds the whole game
+void tetris_save(const void *state, size_t size)
+{
+    dataset_flush_partial();
+    const tetris_state *session = state;
+    if(size < sizeof(tetris_state))
+        return;
+    stats_save_game(session->score, session->lines, session->pieces, (session->ended_us - session->started_us) / 1000);
+}
+
+static const console_repeat tetris_repeat[BUTTON_COUNT] = {
+    [BUTTON_LEFT] = {INPUT_DAS_US, INPUT_ARR_US},
+    [BUTTON_DOWN] = {INPUT_SOFT_DROP_US, INPUT_SOFT_DROP_US},
+    [BUTTON_UP] = {0, 0},
+    [BUTTON_RIGHT] = {INPUT_DAS_US, INPUT_ARR_US},
+};
+
+const console_game tetris_game = {
+    .name = "Tetris",
+    .repeat = tetris_repeat,
+    .init = tetris_init,
+    .on_input = tetris_on_input,
+    .tick = tetris_tick,
+    .render = tetris_render,
+    .serialize = tetris_serialize,
+    .save = tetris_save,
+};
@@ -0,0 +1,19 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+//counts failed checks and keeps going, a test's main returns check_failures
+static int check_failures = 0;
+
+#define CHECK(condition, format, ...) \
+    do \
+    { \
+        if(!(condition)) \
+        { \
+            printf("%s:%d: %s: " format "\n", __FILE__, __LINE__, #condition, ##__VA_ARGS__); \
+            check_failures++; \
+        } \
+    } while(0)
+
+#endif
@@ -0,0 +1,51 @@
+//the platform calls main/ makes that the host tests do not look at
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_timer.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <freertos/task.h>
+#include <u8g2.h>
+
+#include "console.h"
+#include "diagnostics.h"
+#include "telemetry.h"
+
+static int64_t host_now_us = 1;
+
+int64_t esp_timer_get_time(void)
+{
+    return host_now_us;
+}
+
+void host_set_time(int64_t now_us)
+{
+    host_now_us = now_us;
+}
+
+void vTaskDelay(TickType_t ticks) {}
+
+esp_err_t nvs_flash_init(void) { return ESP_FAIL; }
+esp_err_t nvs_flash_erase(void) { return ESP_FAIL; }
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) { return ESP_FAIL; }
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length) { return ESP_FAIL; }
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) { return ESP_FAIL; }
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_FAIL; }
+
+u8g2_t u8g2;
+const uint8_t u8g2_font_4x6_tf[1], u8g2_font_5x8_tr[1], u8g2_font_6x10_tr[1], u8g2_font_helvB10_tr[1];
+
+void u8g2_SetFont(u8g2_t *u8g2, const uint8_t *font) {}
+void u8g2_SetDrawColor(u8g2_t *u8g2, uint8_t color) {}
+uint16_t u8g2_GetStrWidth(u8g2_t *u8g2, const char *s) { return 0; }
+uint16_t u8g2_DrawStr(u8g2_t *u8g2, uint16_t x, uint16_t y, const char *s) { return 0; }
+void u8g2_DrawLine(u8g2_t *u8g2, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {}
+void u8g2_DrawBox(u8g2_t *u8g2, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {}
+void u8g2_DrawFrame(u8g2_t *u8g2, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {}
+
+short int display_number_width(int value, short int scale) { return 0; }
+void display_draw_number(short int x_right, short int y_top, int value, short int scale) {}
+
+void diagnostics_static(const char *subsystem, size_t bytes) {}
+void telemetry_record(telemetry_event_type type, uint8_t value, uint16_t extra, uint32_t arg) {}
@@ -0,0 +1,32 @@
+//host stand-in for the ESP-IDF header, a test provides uart_write_bytes to see what was sent
+#pragma once
+
+#include <stddef.h>
+
+#include "esp_err.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_2         2
+#define UART_PIN_NO_CHANGE -1
+
+typedef enum { UART_DATA_8_BITS } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE } uart_hw_flowcontrol_t;
+typedef enum { UART_SCLK_DEFAULT } uart_sclk_t;
+
+typedef struct uart_config_t
+{
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer, int tx_buffer, int queue_size, void *queue, int flags);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+int uart_write_bytes(uart_port_t port, const void *data, size_t size);
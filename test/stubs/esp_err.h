@@ -0,0 +1,11 @@
+//host stand-in for the ESP-IDF header, only what the tested code uses
+#pragma once
+
+typedef int esp_err_t;
+
+#define ESP_OK   0
+#define ESP_FAIL -1
+#define ESP_ERR_NVS_NO_FREE_PAGES     0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+#define ESP_ERR_NVS_NOT_FOUND         0x1102
+#define ESP_ERROR_CHECK(x) ((void)(x))
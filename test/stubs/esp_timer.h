@@ -0,0 +1,7 @@
+//host stand-in for the ESP-IDF header, the time is whatever the test sets with host_set_time
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+void host_set_time(int64_t now_us);
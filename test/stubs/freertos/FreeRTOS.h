@@ -0,0 +1,6 @@
+//host stand-in for the FreeRTOS header, only what the tested code uses
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
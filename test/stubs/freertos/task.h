@@ -0,0 +1,8 @@
+//host stand-in for the FreeRTOS header, delays return right away
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+void vTaskDelay(TickType_t ticks);
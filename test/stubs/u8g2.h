@@ -0,0 +1,20 @@
+//host stand-in for the u8g2 header, drawing does nothing on the host
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct u8g2_struct
+{
+    uint8_t unused;
+} u8g2_t;
+
+extern const uint8_t u8g2_font_4x6_tf[], u8g2_font_5x8_tr[], u8g2_font_6x10_tr[], u8g2_font_helvB10_tr[];
+
+void u8g2_SetFont(u8g2_t *u8g2, const uint8_t *font);
+void u8g2_SetDrawColor(u8g2_t *u8g2, uint8_t color);
+uint16_t u8g2_GetStrWidth(u8g2_t *u8g2, const char *s);
+uint16_t u8g2_DrawStr(u8g2_t *u8g2, uint16_t x, uint16_t y, const char *s);
+void u8g2_DrawLine(u8g2_t *u8g2, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void u8g2_DrawBox(u8g2_t *u8g2, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+void u8g2_DrawFrame(u8g2_t *u8g2, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
@@ -0,0 +1,121 @@
+#define DATASET_EXPORT 1
+#include "../main/dataset.c"
+
+#include "check.h"
+
+#define TEST_STREAM_BYTES (16 * sizeof(dataset_chunk))
+
+//everything dataset.c wrote to the uart
+static uint8_t test_stream[TEST_STREAM_BYTES];
+static size_t test_stream_size = 0;
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer, int tx_buffer, int queue_size, void *queue, int flags) { return ESP_OK; }
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config) { return ESP_OK; }
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts) { return ESP_OK; }
+
+int uart_write_bytes(uart_port_t port, const void *data, size_t size)
+{
+    if(test_stream_size + size > TEST_STREAM_BYTES)
+        return -1;
+    memcpy(test_stream + test_stream_size, data, size);
+    test_stream_size += size;
+    return size;
+}
+
+//record i has every field derived from i, so the reader side can tell any record apart
+static void test_record(int i)
+{
+    dataset_sample sample;
+    for(int row = 0; row < DATASET_BOARD_ROWS; row++)
+        sample.rows[row] = i * DATASET_BOARD_ROWS + row;
+    sample.block_id = i % 9, sample.next_id = (i + 1) % 9;
+    sample.block_x = i % 13 - 2;
+    sample.rotation = i % 4, sample.lines = i % 5;
+    sample.score_delta = i * 1000 + 7;
+    dataset_record(&sample);
+}
+
+static uint16_t test_u16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+//walks the stream the way tools/dataset_read.py does, the column layout follows from each chunk's count,
+//and checks records first .. first + expected - 1 in order. returns the chunk sizes seen
+static int test_read_stream(int first, int expected, int *chunk_counts, int max_chunks)
+{
+    size_t pos = 0;
+    int record = first, chunks = 0;
+    while(pos + DATASET_HEADER_SIZE <= test_stream_size && chunks < max_chunks)
+    {
+        const uint8_t *header = test_stream + pos;
+        CHECK(memcmp(header, DATASET_MAGIC, 4) == 0, "no chunk magic at byte %d", (int)pos);
+        int count = test_u16(header + 4), length = test_u16(header + 6);
+        CHECK(length == count * (DATASET_BOARD_ROWS * 2 + 9), "chunk of %d records is %d bytes", count, length);
+        const uint8_t *rows = header + DATASET_HEADER_SIZE;
+        const uint8_t *bytes = rows + count * DATASET_BOARD_ROWS * 2;
+        const uint8_t *score = bytes + 5 * count;
+        for(int j = 0; j < count; j++, record++)
+        {
+            CHECK(test_u16(rows + (j * DATASET_BOARD_ROWS + 3) * 2) == (uint16_t)(record * DATASET_BOARD_ROWS + 3),
+                "record %d rows", record);
+            CHECK(bytes[j] == record % 9 && bytes[count + j] == (record + 1) % 9, "record %d block ids", record);
+            CHECK((int8_t)bytes[2 * count + j] == record % 13 - 2, "record %d column", record);
+            CHECK(bytes[3 * count + j] == record % 4 && bytes[4 * count + j] == record % 5, "record %d rotation or lines", record);
+            CHECK(test_u16(score + 4 * j) + (test_u16(score + 4 * j + 2) << 16) == (uint32_t)(record * 1000 + 7),
+                "record %d score", record);
+        }
+        chunk_counts[chunks++] = count;
+        pos += DATASET_HEADER_SIZE + length;
+    }
+    CHECK(pos == test_stream_size, "%d bytes left over", (int)(test_stream_size - pos));
+    CHECK(record - first == expected, "read %d records, wrote %d", record - first, expected);
+    return chunks;
+}
+
+//full chunks go out as they fill, the unfinished one only when flushed, packed down to its count
+static void test_partial_chunk(void)
+{
+    int counts[8];
+    test_stream_size = 0;
+    for(int i = 0; i < 150; i++)
+        test_record(i);
+    CHECK(test_stream_size == 2 * sizeof(dataset_chunk), "%d bytes sent before the flush", (int)test_stream_size);
+    dataset_flush_partial();
+    int chunks = test_read_stream(0, 150, counts, 8);
+    CHECK(chunks == 3 && counts[0] == 64 && counts[1] == 64 && counts[2] == 22, "%d chunks, last of %d records",
+        chunks, chunks > 0 ? counts[chunks - 1] : 0);
+}
+
+//a flush with nothing pending sends nothing, not an empty chunk
+static void test_flush_when_empty(void)
+{
+    int counts[8];
+    test_stream_size = 0;
+    for(int i = 0; i < DATASET_CHUNK_RECORDS; i++)
+        test_record(i);
+    dataset_flush_partial();
+    dataset_flush_partial();
+    int chunks = test_read_stream(0, DATASET_CHUNK_RECORDS, counts, 8);
+    CHECK(chunks == 1, "%d chunks for one full chunk of records", chunks);
+}
+
+//a single record still makes a readable chunk
+static void test_single_record(void)
+{
+    int counts[8];
+    test_stream_size = 0;
+    test_record(41);
+    dataset_flush_partial();
+    CHECK(test_read_stream(41, 1, counts, 8) == 1 && counts[0] == 1, "one record did not make one chunk");
+}
+
+int main(void)
+{
+    dataset_init();
+    test_partial_chunk();
+    test_flush_when_empty();
+    test_single_record();
+    printf("%s\n", check_failures ? "FAILED" : "ok");
+    return check_failures != 0;
+}
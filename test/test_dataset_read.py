@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""Checks that tools/dataset_read.py finds every real chunk however the noise around it looks."""
+
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools"))
+import dataset_read  # noqa: E402
+
+RECORD_SIZE = dataset_read.BOARD_ROWS * 2 + 9
+
+
+def chunk(first, count):
+    """A chunk of count records, record i has block_id i % 9 and score_delta i."""
+    ids = list(range(first, first + count))
+    payload = bytes(count * dataset_read.BOARD_ROWS * 2)
+    payload += bytes(i % 9 for i in ids) + bytes(count * 4)
+    payload += b"".join(struct.pack("<I", i) for i in ids)
+    return dataset_read.MAGIC + struct.pack("<HH", count, len(payload)) + payload
+
+
+def scores(data):
+    return [score for _, cols in dataset_read.chunks(data) for score in cols["score_delta"]]
+
+
+def main():
+    failures = 0
+    cases = {
+        # a magic in the noise whose length field does not match its count, the real chunk starts inside that length
+        "bogus length": b"xx" + dataset_read.MAGIC + struct.pack("<HH", 1, 40) + chunk(0, 3) + chunk(3, 2),
+        # a magic whose length runs past the end of the stream, a whole chunk still follows it
+        "length past the end": dataset_read.MAGIC + struct.pack("<HH", 200, 200 * RECORD_SIZE) + chunk(0, 5),
+        # a chunk cut off by the end of the recording
+        "cut-off last chunk": chunk(0, 4) + chunk(4, 3)[:-1],
+    }
+    expected = {"bogus length": list(range(5)), "length past the end": list(range(5)), "cut-off last chunk": list(range(4))}
+    for name, data in cases.items():
+        found = scores(data)
+        if found != expected[name]:
+            print("%s: read records %s, expected %s" % (name, found, expected[name]))
+            failures += 1
+    print("FAILED" if failures else "ok")
+    return failures != 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
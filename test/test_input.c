@@ -0,0 +1,89 @@
+#include "../main/input.c"
+
+#include <stdlib.h>
+
+#include "check.h"
+
+#define TEST_DELAY_US  170000
+#define TEST_REPEAT_US 50000
+
+static input_repeat test_button(void)
+{
+    input_repeat button = {.delay_us = TEST_DELAY_US, .repeat_us = TEST_REPEAT_US};
+    return button;
+}
+
+//the press itself is one step, the first repeat comes delay_us after it and every later one repeat_us apart
+static void test_repeat_timing(void)
+{
+    input_repeat button = test_button();
+    int64_t pressed_us = 1000;
+    CHECK(input_repeat_update(&button, true, pressed_us) == 1, "the press is not a step");
+    CHECK(input_repeat_update(&button, true, pressed_us + TEST_DELAY_US - 1) == 0, "repeat before the delay");
+    CHECK(input_repeat_update(&button, true, pressed_us + TEST_DELAY_US) == 1, "no repeat at the delay");
+    CHECK(input_repeat_update(&button, true, pressed_us + TEST_DELAY_US + TEST_REPEAT_US - 1) == 0,
+        "second repeat before the repeat interval");
+    CHECK(input_repeat_update(&button, true, pressed_us + TEST_DELAY_US + TEST_REPEAT_US) == 1,
+        "no second repeat after the repeat interval");
+}
+
+//a late caller gets every step it missed at once
+static void test_late_caller_catches_up(void)
+{
+    input_repeat button = test_button();
+    input_repeat_update(&button, true, 0);
+    short int steps = input_repeat_update(&button, true, TEST_DELAY_US + 3 * TEST_REPEAT_US);
+    CHECK(steps == 4, "%d steps after the delay and three intervals", steps);
+}
+
+//how often the button is read must not change how many steps a hold produces
+static void test_steps_do_not_depend_on_frame_spacing(void)
+{
+    const int64_t hold_us = 2000000;
+    const int expected = 1 + 1 + (hold_us - TEST_DELAY_US) / TEST_REPEAT_US;
+    const int64_t spacings_us[] = {1000, 16667, 33333, 40000, 99999, 0};
+    srand(3);
+    for(int s = 0; s < sizeof(spacings_us) / sizeof(spacings_us[0]); s++)
+    {
+        input_repeat button = test_button();
+        int steps = 0;
+        int64_t now_us = 0;
+        while(true)
+        {
+            steps += input_repeat_update(&button, true, now_us);
+            if(now_us == hold_us)
+                break;
+            //spacing 0 stands for random frame times
+            now_us += spacings_us[s] ? spacings_us[s] : 1 + rand() % 60000;
+            if(now_us > hold_us)
+                now_us = hold_us;
+        }
+        CHECK(steps == expected, "%d steps with %d us frames, %d expected", steps, (int)spacings_us[s], expected);
+    }
+}
+
+//repeat_us == 0 fires only on the press, releasing re-arms the press
+static void test_edge_only_and_release(void)
+{
+    input_repeat button = {.delay_us = 0, .repeat_us = 0};
+    CHECK(input_repeat_update(&button, true, 0) == 1, "edge-only press is not a step");
+    CHECK(input_repeat_update(&button, true, 10000000) == 0, "edge-only button repeated");
+    CHECK(input_repeat_update(&button, false, 10000001) == 0, "release is a step");
+    CHECK(input_repeat_update(&button, true, 10000002) == 1, "second press is not a step");
+
+    button = test_button();
+    input_repeat_update(&button, true, 0);
+    input_repeat_update(&button, false, TEST_DELAY_US - 1);
+    CHECK(input_repeat_update(&button, true, TEST_DELAY_US) == 1, "a new press does not start over");
+    CHECK(input_repeat_update(&button, true, 2 * TEST_DELAY_US - 1) == 0, "delay not restarted by the new press");
+}
+
+int main(void)
+{
+    test_repeat_timing();
+    test_late_caller_catches_up();
+    test_steps_do_not_depend_on_frame_spacing();
+    test_edge_only_and_release();
+    printf("%s\n", check_failures ? "FAILED" : "ok");
+    return check_failures != 0;
+}
@@ -0,0 +1,251 @@
+#define TETRIS_CHECK_INVARIANTS 1
+#define TETRIS_SOAK_TICKS       300000
+#define TETRIS_SOAK_SEED        1
+#include "../main/tetris.c"
+
+#include "check.h"
+
+#define TEST_FRAME_US 33333
+
+static console_input test_press(console_button button)
+{
+    console_input input = {0};
+    input.steps[button] = 1;
+    input.held[button] = true;
+    return input;
+}
+
+//an empty board with the given block placed by hand, as if it had just spawned there
+static void test_place_block(short int id, short int x, short int y, block_rotation rotation, int64_t now_us)
+{
+    tetris_reset();
+    memset(tetris_map, 0, sizeof(tetris_map));
+    tetris_spawn_block(id, now_us);
+    tetris.block_x = x, tetris.block_y = y, tetris.rotation = rotation;
+}
+
+//random and bursty input with several frames per tick, every tick checked against the board invariants
+static void test_soak(void)
+{
+    CHECK(tetris_soak(), "soak from seed %d broke an invariant", TETRIS_SOAK_SEED);
+}
+
+//every lock state the search reports is reached by replaying its path through the real move and
+//kick rules, and the block rests there
+static void test_reach_paths(void)
+{
+    static int16_t locks[TETRIS_REACH_STATES];
+    console_button inputs[64];
+    long placements = 0;
+    srand(5);
+    for(int board = 0; board < 2000; board++)
+    {
+        for(int y = 0; y < TETRIS_MAP_HEIGHT; y++)
+            for(int x = 0; x < TETRIS_MAP_WIDTH; x++)
+                tetris_map[y][x] = y < rand() % 12 && rand() % 3;
+        short int id = rand() % TETRIS_NUMBER_OF_BLOCKS;
+        short int count = tetris_reach_search(id, TETRIS_MAP_WIDTH / 2 - 1, TETRIS_MAP_HEIGHT - 1, NO_ROTATION, locks);
+        for(short int j = 0; j < count; j++)
+        {
+            short int length = tetris_reach_path(locks[j], inputs, 64);
+            if(length < 0)
+                continue;
+            short int x = TETRIS_MAP_WIDTH / 2 - 1, y = TETRIS_MAP_HEIGHT - 1;
+            block_rotation rotation = NO_ROTATION;
+            bool fits = true;
+            for(short int k = 0; k < length && fits; k++)
+            {
+                if(inputs[k] == BUTTON_LEFT)
+                    x--;
+                else if(inputs[k] == BUTTON_RIGHT)
+                    x++;
+                else if(inputs[k] == BUTTON_DOWN)
+                    y--;
+                else
+                {
+                    const tetris_kick *kick = tetris_find_kick(x, y, id, rotation);
+                    if(kick == NULL)
+                        break;
+                    x += kick->dx, y += kick->dy, rotation = tetris_rotate_clockwise(rotation);
+                }
+                fits = tetris_block_fits(x, y, id, rotation);
+            }
+            CHECK(fits && tetris_reach_state(x, y, rotation) == locks[j], "board %d block %d path %d ends at %d,%d,%d",
+                board, id, j, x, y, rotation);
+            CHECK(!tetris_block_fits(x, y - 1, id, rotation), "board %d block %d lock %d,%d,%d is not resting",
+                board, id, x, y, rotation);
+            placements++;
+        }
+    }
+    memset(tetris_map, 0, sizeof(tetris_map));
+    CHECK(placements > 50000, "only %ld placements checked", placements);
+}
+
+//a soft drop latched on a ledge must not lock the block after a later frame moved it off the ledge
+static void test_soft_drop_latch(void)
+{
+    test_place_block(0, 4, 5, NO_ROTATION, 1000);
+    tetris_map[4][4] = true;
+    console_input down = test_press(BUTTON_DOWN), right = test_press(BUTTON_RIGHT);
+    tetris_on_input(&down);
+    tetris_on_input(&right);
+    tetris_tick(2000);
+    CHECK(tetris.pieces == 0 && !tetris_map[5][5], "block locked in mid-air at %d,%d", tetris.block_x, tetris.block_y);
+}
+
+//spinning and shuffling a block on the floor uses up the lock delay restarts, it cannot stay up forever
+static void test_lock_delay_is_bounded(void)
+{
+    int64_t now_us = 1000;
+    test_place_block(2, 4, 1, NO_ROTATION, now_us);
+    int64_t limit_us = (TETRIS_LOCK_RESETS + 2) * (int64_t)TETRIS_LOCK_DELAY_US;
+    for(int frame = 0; tetris.pieces == 0 && now_us < limit_us; frame++)
+    {
+        now_us += TEST_FRAME_US;
+        console_input spin = test_press(BUTTON_UP);
+        spin.steps[frame % 2 ? BUTTON_LEFT : BUTTON_RIGHT] = 1;
+        tetris_on_input(&spin);
+        tetris_tick(now_us);
+    }
+    CHECK(tetris.pieces == 1, "block still up after %d ms of spinning on the floor", (int)(now_us / 1000));
+}
+
+//every block in every rotation turns clockwise wherever it rests on the floor or on a flat stack,
+//touching either wall or not, and every kick it takes lands where the block fits
+static void test_kicks_on_flat_stacks(void)
+{
+    for(short int height = 0; height < TETRIS_MAP_HEIGHT / 2; height++)
+    {
+        memset(tetris_map, 0, sizeof(tetris_map));
+        for(short int y = 0; y < height; y++)
+            for(short int x = 0; x < TETRIS_MAP_WIDTH; x++)
+                tetris_map[y][x] = true;
+        for(short int id = 0; id < TETRIS_NUMBER_OF_BLOCKS; id++)
+            for(short int r = 0; r < 4; r++)
+                for(short int x = 0; x < TETRIS_MAP_WIDTH; x++)
+                {
+                    short int y = height;
+                    while(y < TETRIS_MAP_HEIGHT && !tetris_block_fits(x, y, id, (block_rotation)r))
+                        y++;
+                    if(y == TETRIS_MAP_HEIGHT)
+                        continue;
+                    const tetris_kick *kick = tetris_find_kick(x, y, id, (block_rotation)r);
+                    CHECK(kick != NULL, "block %d rotation %d at %d,%d on a stack of %d cannot turn", id, r, x, y, height);
+                    if(kick != NULL)
+                        CHECK(tetris_block_fits(x + kick->dx, y + kick->dy, id, tetris_rotate_clockwise((block_rotation)r)),
+                            "block %d rotation %d kick %d,%d does not fit", id, r, kick->dx, kick->dy);
+                }
+    }
+    memset(tetris_map, 0, sizeof(tetris_map));
+}
+
+//marks the cells a block covers at an anchor, false if it does not fit on an empty board
+static bool test_block_cells(short int x, short int y, short int id, block_rotation rotation, bool cells[TETRIS_MAP_HEIGHT][TETRIS_MAP_WIDTH])
+{
+    memset(tetris_map, 0, sizeof(tetris_map));
+    if(!tetris_block_fits(x, y, id, rotation))
+        return false;
+    for(short int cy = 0; cy < TETRIS_MAP_HEIGHT; cy++)
+        for(short int cx = 0; cx < TETRIS_MAP_WIDTH; cx++)
+        {
+            tetris_map[cy][cx] = true;
+            cells[cy][cx] |= !tetris_block_fits(x, y, id, rotation);
+            tetris_map[cy][cx] = false;
+        }
+    return true;
+}
+
+//every (id, rotation, kick) entry is the one taken somewhere: with every cell filled except the ones the
+//block and that kick need, the offsets before it are blocked and the rotation goes through this one
+static void test_every_kick_is_taken(void)
+{
+    static bool cells[TETRIS_MAP_HEIGHT][TETRIS_MAP_WIDTH];
+    for(short int id = 0; id < TETRIS_NUMBER_OF_BLOCKS; id++)
+        for(short int r = 0; r < 4; r++)
+        {
+            const tetris_kick_list *kicks = tetris_kicks[id][r];
+            block_rotation turned = tetris_rotate_clockwise((block_rotation)r);
+            for(short int i = 0; i < kicks->count; i++)
+            {
+                const tetris_kick *kick = &kicks->offsets[i];
+                bool taken = false;
+                for(short int y = 0; y < TETRIS_MAP_HEIGHT && !taken; y++)
+                    for(short int x = 0; x < TETRIS_MAP_WIDTH && !taken; x++)
+                    {
+                        memset(cells, 0, sizeof(cells));
+                        if(!test_block_cells(x, y, id, (block_rotation)r, cells)
+                            || !test_block_cells(x + kick->dx, y + kick->dy, id, turned, cells))
+                            continue;
+                        for(short int cy = 0; cy < TETRIS_MAP_HEIGHT; cy++)
+                            for(short int cx = 0; cx < TETRIS_MAP_WIDTH; cx++)
+                                tetris_map[cy][cx] = !cells[cy][cx];
+                        taken = tetris_find_kick(x, y, id, (block_rotation)r) == kick;
+                    }
+                CHECK(taken, "block %d rotation %d never takes kick %d (%d,%d)", id, r, i, kick->dx, kick->dy);
+            }
+        }
+    memset(tetris_map, 0, sizeof(tetris_map));
+}
+
+//rows fallen by each tick, with the block put back at the top after every tick so it never lands
+//and the fraction of a row carries over. after every tick the total must be what the elapsed time
+//gives at the level's fixed-point gravity, however the time was cut into ticks
+static void test_gravity_is_exact(void)
+{
+    const int64_t spacings_us[] = {1000, 10000, 16667, 33333, 0};
+    const int64_t run_us = 10000000;
+    srand(7);
+    for(short int level = 0; level < TETRIS_NUMBER_OF_LEVELS; level++)
+        for(int s = 0; s < sizeof(spacings_us) / sizeof(spacings_us[0]); s++)
+        {
+            //spacing 0 stands for random tick times up to 30 ms, skipped where a tick would fall past the floor
+            int64_t longest_us = spacings_us[s] ? spacings_us[s] : 30000;
+            uint32_t gravity = tetris_levels[level].gravity;
+            if(gravity * longest_us / TETRIS_FALL_ROW + 1 >= TETRIS_MAP_HEIGHT - 1)
+                continue;
+            test_place_block(0, 4, TETRIS_MAP_HEIGHT - 1, NO_ROTATION, 0);
+            tetris.level = level;
+            int64_t now_us = 0, rows = 0;
+            bool exact = true;
+            while(now_us < run_us && exact)
+            {
+                now_us += spacings_us[s] ? spacings_us[s] : 1 + rand() % 30000;
+                tetris_tick(now_us);
+                rows += TETRIS_MAP_HEIGHT - 1 - tetris.block_y;
+                tetris.block_y = TETRIS_MAP_HEIGHT - 1;
+                exact = rows == gravity * now_us / TETRIS_FALL_ROW;
+            }
+            CHECK(exact, "level %d with %d us ticks fell %d rows in %d ms, %d expected", level, (int)spacings_us[s],
+                (int)rows, (int)(now_us / 1000), (int)(gravity * now_us / TETRIS_FALL_ROW));
+        }
+}
+
+//the fixed-point gravity is within a hundredth of a row per second of the documented speed, and
+//levels never get slower
+static void test_level_speeds(void)
+{
+    const double cells_per_s[] = {6, 7.5, 10, 15, 30, 36, 43, 52, 62, 75, 90, 120, 150, 180, 210, 240, 300, 360, 420,
+        480, 540, 600};
+    CHECK(TETRIS_NUMBER_OF_LEVELS == sizeof(cells_per_s) / sizeof(cells_per_s[0]), "%d levels", (int)TETRIS_NUMBER_OF_LEVELS);
+    for(short int level = 0; level < TETRIS_NUMBER_OF_LEVELS; level++)
+    {
+        double rate = tetris_levels[level].gravity * 1000000.0 / TETRIS_FALL_ROW;
+        CHECK(rate > cells_per_s[level] - 0.01 && rate < cells_per_s[level] + 0.01, "level %d falls %.3f cells/s", level, rate);
+        if(level > 0)
+            CHECK(tetris_levels[level].gravity >= tetris_levels[level - 1].gravity, "level %d is slower than the one before", level);
+    }
+}
+
+int main(void)
+{
+    test_soak();
+    test_reach_paths();
+    test_soft_drop_latch();
+    test_lock_delay_is_bounded();
+    test_kicks_on_flat_stacks();
+    test_every_kick_is_taken();
+    test_gravity_is_exact();
+    test_level_speeds();
+    printf("%s\n", check_failures ? "FAILED" : "ok");
+    return check_failures != 0;
+}
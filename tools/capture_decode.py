@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Turns a DISPLAY_CAPTURE stream into a PNG per frame.
+
+Record the stream from the capture UART, e.g.
+
+    stty -F /dev/ttyUSB1 921600 raw && cat /dev/ttyUSB1 > capture.bin
+
+then run
+
+    tools/capture_decode.py capture.bin frames/
+
+Only the Python standard library is needed.
+"""
+
+import os
+import struct
+import sys
+import zlib
+
+WIDTH = 128
+HEIGHT = 64
+FRAME_BYTES = WIDTH * HEIGHT // 8
+SYNC = b"\xc5\x7a"
+FLAG_KEY = 0x01
+HEADER = struct.Struct("<2sBHH")
+
+
+def apply_delta(frame, payload, key):
+    """XORs one payload into the frame, a key frame starts from a blank screen."""
+    if key:
+        frame[:] = bytes(FRAME_BYTES)
+    pos = 0
+    i = 0
+    while i < len(payload):
+        token = payload[i]
+        i += 1
+        count = (token & 0x7F) + 1
+        if token & 0x80:
+            pos += count
+            continue
+        for byte in payload[i:i + count]:
+            frame[pos] ^= byte
+            pos += 1
+        i += count
+
+
+def write_png(path, frame):
+    rows = bytearray()
+    for y in range(HEIGHT):
+        rows.append(0)
+        page = (y // 8) * WIDTH
+        bit = 1 << (y % 8)
+        for x in range(WIDTH):
+            rows.append(255 if frame[page + x] & bit else 0)
+
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack(">I", len(data)) + body + struct.pack(">I", zlib.crc32(body))
+
+    with open(path, "wb") as out:
+        out.write(b"\x89PNG\r\n\x1a\n")
+        out.write(chunk(b"IHDR", struct.pack(">IIBBBBB", WIDTH, HEIGHT, 8, 0, 0, 0, 0)))
+        out.write(chunk(b"IDAT", zlib.compress(bytes(rows))))
+        out.write(chunk(b"IEND", b""))
+
+
+def decode(stream, out_dir):
+    frame = bytearray(FRAME_BYTES)
+    synced = False
+    written = 0
+    pos = 0
+    while True:
+        start = stream.find(SYNC, pos)
+        if start < 0 or start + HEADER.size > len(stream):
+            break
+        _, flags, _, length = HEADER.unpack_from(stream, start)
+        payload = stream[start + HEADER.size:start + HEADER.size + length]
+        if len(payload) < length:
+            break
+        pos = start + HEADER.size + length
+
+        key = bool(flags & FLAG_KEY)
+        if not synced and not key:
+            continue
+        synced = True
+        apply_delta(frame, payload, key)
+        # the header's 16-bit frame number wraps, so files are numbered by the decoder instead
+        write_png(os.path.join(out_dir, "frame_%06d.png" % written), frame)
+        written += 1
+    return written
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: capture_decode.py <capture.bin> <output dir>")
+    with open(sys.argv[1], "rb") as f:
+        stream = f.read()
+    os.makedirs(sys.argv[2], exist_ok=True)
+    print("%d frames written" % decode(stream, sys.argv[2]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Scans a DATASET_EXPORT stream of placements without copying it.
+
+Record the stream from the dataset UART, e.g.
+
+    stty -F /dev/ttyUSB2 921600 raw && cat /dev/ttyUSB2 > placements.bin
+
+then run
+
+    tools/dataset_read.py placements.bin
+
+The file is mapped with mmap and every column is a memoryview into the map,
+so scanning one field never touches the others. Only the Python standard
+library is needed.
+"""
+
+import mmap
+import sys
+import time
+
+MAGIC = b"TDS1"
+HEADER_SIZE = 8
+BOARD_ROWS = 20
+NUMBER_OF_BLOCKS = 9
+
+
+def columns(view, count):
+    """Splits one chunk payload into its columns, all views into the mapped file."""
+    out = {}
+    pos = 0
+    out["rows"] = view[pos:pos + count * BOARD_ROWS * 2].cast("H")
+    pos += count * BOARD_ROWS * 2
+    for name in ("block_id", "next_id", "block_x", "rotation", "lines"):
+        out[name] = view[pos:pos + count].cast("b" if name == "block_x" else "B")
+        pos += count
+    out["score_delta"] = view[pos:pos + count * 4].cast("I")
+    return out
+
+
+def chunks(data):
+    """Yields (record count, columns) for every whole chunk, skipping noise between chunks."""
+    view = memoryview(data)
+    pos = 0
+    while True:
+        start = data.find(MAGIC, pos)
+        if start < 0 or start + HEADER_SIZE > len(data):
+            return
+        count = data[start + 4] | data[start + 5] << 8
+        length = data[start + 6] | data[start + 7] << 8
+        end = start + HEADER_SIZE + length
+        # a magic inside noise or a cut-off chunk: the real next chunk may start within its claimed length
+        if end > len(data) or length != count * (BOARD_ROWS * 2 + 9):
+            pos = start + 1
+            continue
+        pos = end
+        yield count, columns(view[start + HEADER_SIZE:end], count)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: dataset_read.py <placements.bin>")
+    with open(sys.argv[1], "rb") as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    started = time.perf_counter()
+    records = 0
+    pieces = [0] * NUMBER_OF_BLOCKS
+    clears = [0] * 5
+    score = 0
+    for count, cols in chunks(data):
+        records += count
+        for block_id in cols["block_id"]:
+            if block_id < NUMBER_OF_BLOCKS:
+                pieces[block_id] += 1
+        for lines in cols["lines"]:
+            clears[min(lines, 4)] += 1
+        score += sum(cols["score_delta"])
+        for col in cols.values():
+            col.release()
+    elapsed = time.perf_counter() - started
+
+    if records == 0:
+        sys.exit("no placements found")
+    print("%d records, %d bytes, %.1f MB per million records" % (records, len(data), len(data) / records))
+    print("scanned at %d records/s" % (records / elapsed if elapsed > 0 else 0))
+    print("pieces by id: %s" % " ".join(str(n) for n in pieces))
+    print("placements clearing 0/1/2/3/4 rows: %s" % " ".join(str(n) for n in clears))
+    print("score per placement: %.1f" % (score / records))
+
+
+if __name__ == "__main__":
+    main()